@@ -0,0 +1,327 @@
+/*- pngbatch
+ *
+ * COPYRIGHT: Written by the libpng contributors, 2026.
+ * To the extent possible under law, the author has waived all copyright and
+ * related or neighboring rights to this work.  This work is published from:
+ * United States.
+ *
+ * Decode a batch of PNG images held in memory using a pool of threads and the
+ * 'simplified API' introduced in libpng-1.6.0.
+ *
+ * The command line has the general format:
+ *
+ *    pngbatch [--threads=N] [--format=gray|ga|rgb|rgba|linear] {file.png}
+ *
+ * All the files are read into memory first; the decoding is then shared out
+ * between N threads (4 by default) and a summary line is printed for each
+ * image, in command line order.  The exit status is 0 only if every image was
+ * decoded.
+ *
+ * libpng itself does not create threads.  A png_image (and the png_struct
+ * inside it) must only be used by one thread at a time, but separate images
+ * can be decoded concurrently without any locking because libpng has no
+ * modifiable global state; the sRGB conversion tables used by the simplified
+ * API are constant data shared by every decode.  The simplified API reports
+ * errors through the return value and png_image::message, so no setjmp is
+ * required in the application.
+ *
+ * This shows one way of organizing such a batch:
+ *
+ *  1) A job is an input buffer together with the slot for its result.  Threads
+ *     take the next unclaimed job from a shared counter, so a thread that gets
+ *     small images simply processes more of them.
+ *  2) Each thread keeps its output buffer between jobs and only reallocates it
+ *     when a bigger image arrives; in a real application the decoded pixels
+ *     would be consumed (or the buffer handed on) before the next job.
+ *  3) The result of each job is stored in its own slot, so no locking is needed
+ *     to report it.
+ *
+ * Build with, for example:
+ *
+ *    cc -o pngbatch pngbatch.c -lpng16 -lz -lm -lpthread
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+/* Normally use <png.h> here to get the installed libpng, but this is done to
+ * ensure the code picks up the local libpng implementation:
+ */
+#include "../../png.h"
+
+#ifdef PNG_SIMPLIFIED_READ_SUPPORTED
+
+#define MAX_THREADS 64
+
+struct job
+{
+   /* Input */
+   const char   *file_name;
+   png_bytep     data;
+   size_t        size;
+
+   /* Output, written only by the thread that claims the job */
+   int           ok;
+   png_uint_32   width;
+   png_uint_32   height;
+   char          message[64];
+};
+
+struct batch
+{
+   struct job      *jobs;
+   unsigned int     count;
+   png_uint_32      format;
+
+   pthread_mutex_t  lock;
+   unsigned int     next;  /* the next unclaimed job, protected by lock */
+};
+
+static struct job *
+claim_job(struct batch *batch)
+{
+   struct job *job = NULL;
+
+   pthread_mutex_lock(&batch->lock);
+
+   if (batch->next < batch->count)
+      job = batch->jobs + batch->next++;
+
+   pthread_mutex_unlock(&batch->lock);
+
+   return job;
+}
+
+static void
+decode_job(struct job *job, png_uint_32 format, png_bytep *buffer,
+   size_t *buffer_size)
+{
+   png_image image;
+
+   memset(&image, 0, sizeof image);
+   image.version = PNG_IMAGE_VERSION;
+
+   if (png_image_begin_read_from_memory(&image, job->data, job->size))
+   {
+      size_t size;
+
+      image.format = format;
+      size = PNG_IMAGE_SIZE(image);
+
+      job->width = image.width;
+      job->height = image.height;
+
+      /* Reuse the buffer of the previous job if it is big enough. */
+      if (size > *buffer_size)
+      {
+         free(*buffer);
+         *buffer = malloc(size);
+         *buffer_size = *buffer != NULL ? size : 0;
+      }
+
+      if (*buffer != NULL)
+      {
+         if (png_image_finish_read(&image, NULL/*background*/, *buffer,
+            0/*row_stride*/, NULL/*colormap*/))
+            job->ok = 1;
+      }
+
+      else
+      {
+         strcpy(image.message, "out of memory");
+         png_image_free(&image);
+      }
+   }
+
+   if (!job->ok)
+   {
+      strncpy(job->message, image.message, (sizeof job->message)-1);
+      job->message[(sizeof job->message)-1] = 0;
+   }
+}
+
+static void *
+worker(void *arg)
+{
+   struct batch *batch = arg;
+   png_bytep buffer = NULL;
+   size_t buffer_size = 0;
+   struct job *job;
+
+   while ((job = claim_job(batch)) != NULL)
+      decode_job(job, batch->format, &buffer, &buffer_size);
+
+   free(buffer);
+   return NULL;
+}
+
+static int
+read_file(struct job *job)
+{
+   FILE *fp;
+
+   errno = 0;
+   fp = fopen(job->file_name, "rb");
+
+   if (fp != NULL)
+   {
+      if (fseek(fp, 0, SEEK_END) == 0)
+      {
+         long cb = ftell(fp);
+
+         if (cb > 0 && fseek(fp, 0, SEEK_SET) == 0)
+         {
+            job->data = malloc((size_t)cb);
+
+            if (job->data != NULL &&
+                fread(job->data, (size_t)cb, 1, fp) == 1)
+            {
+               job->size = (size_t)cb;
+               (void)fclose(fp);
+               return 1;
+            }
+
+            free(job->data);
+            job->data = NULL;
+         }
+      }
+
+      (void)fclose(fp);
+   }
+
+   fprintf(stderr, "pngbatch: %s: %s\n", job->file_name,
+      errno != 0 ? strerror(errno) : "could not read file");
+   return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+   struct batch batch;
+   pthread_t threads[MAX_THREADS];
+   unsigned int nthreads = 4, nstarted = 0, i;
+   int argi, result = 0;
+
+   memset(&batch, 0, sizeof batch);
+   batch.format = PNG_FORMAT_RGBA;
+
+   for (argi = 1; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi)
+   {
+      const char *arg = argv[argi];
+
+      if (strncmp(arg, "--threads=", 10) == 0)
+      {
+         nthreads = (unsigned int)atoi(arg+10);
+
+         if (nthreads < 1 || nthreads > MAX_THREADS)
+         {
+            fprintf(stderr, "pngbatch: %s: 1 to %d threads\n", arg,
+               MAX_THREADS);
+            return 1;
+         }
+      }
+
+      else if (strcmp(arg, "--format=gray") == 0)
+         batch.format = PNG_FORMAT_GRAY;
+
+      else if (strcmp(arg, "--format=ga") == 0)
+         batch.format = PNG_FORMAT_GA;
+
+      else if (strcmp(arg, "--format=rgb") == 0)
+         batch.format = PNG_FORMAT_RGB;
+
+      else if (strcmp(arg, "--format=rgba") == 0)
+         batch.format = PNG_FORMAT_RGBA;
+
+      else if (strcmp(arg, "--format=linear") == 0)
+         batch.format = PNG_FORMAT_LINEAR_RGB_ALPHA;
+
+      else
+      {
+         fprintf(stderr, "pngbatch: %s: unknown option\n", arg);
+         return 1;
+      }
+   }
+
+   if (argi >= argc)
+   {
+      fprintf(stderr, "pngbatch: usage: pngbatch [--threads=N]"
+         " [--format=gray|ga|rgb|rgba|linear] {file.png}\n");
+      return 1;
+   }
+
+   batch.count = (unsigned int)(argc - argi);
+   batch.jobs = calloc(batch.count, sizeof *batch.jobs);
+
+   if (batch.jobs == NULL)
+   {
+      fprintf(stderr, "pngbatch: out of memory\n");
+      return 1;
+   }
+
+   for (i = 0; i < batch.count; ++i)
+   {
+      batch.jobs[i].file_name = argv[argi+i];
+
+      if (!read_file(batch.jobs+i))
+         result = 1;
+   }
+
+   if (result == 0)
+   {
+      pthread_mutex_init(&batch.lock, NULL);
+
+      if (nthreads > batch.count)
+         nthreads = batch.count;
+
+      for (; nstarted < nthreads; ++nstarted)
+         if (pthread_create(threads+nstarted, NULL, worker, &batch) != 0)
+            break;
+
+      if (nstarted == 0)
+      {
+         /* No threads; do the work on this one. */
+         (void)worker(&batch);
+      }
+
+      for (i = 0; i < nstarted; ++i)
+         pthread_join(threads[i], NULL);
+
+      pthread_mutex_destroy(&batch.lock);
+
+      for (i = 0; i < batch.count; ++i)
+      {
+         struct job *job = batch.jobs+i;
+
+         if (job->ok)
+            printf("%s: %lu x %lu\n", job->file_name,
+               (unsigned long)job->width, (unsigned long)job->height);
+
+         else
+         {
+            printf("%s: error: %s\n", job->file_name, job->message);
+            result = 1;
+         }
+      }
+   }
+
+   for (i = 0; i < batch.count; ++i)
+      free(batch.jobs[i].data);
+
+   free(batch.jobs);
+
+   return result;
+}
+#else /* !SIMPLIFIED_READ */
+int
+main(void)
+{
+   fprintf(stderr, "pngbatch: no simplified read support in libpng\n");
+   /* So the test is skipped: */
+   return 77;
+}
+#endif /* SIMPLIFIED_READ */
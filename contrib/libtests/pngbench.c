@@ -0,0 +1,780 @@
+/* pngbench.c
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * Benchmark the libpng read and write paths over a synthetic corpus.
+ *
+ * The corpus is generated in memory at start up and is the same on every run:
+ * every valid color type and bit depth, with and without interlacing, with no
+ * filtering and with adaptive filtering, at one or more image sizes.  For each
+ * image the following are timed:
+ *
+ *    read-seq        png_read_image with no transforms
+ *    read-trusted    the same with png_set_trusted_input, so the difference
+ *                    is the cost of checking the CRCs and Adler-32
+ *    read-push       the progressive reader, fed 64KB at a time
+ *    read-simple     the simplified API, reading to RGBA
+ *    write-lN        png_write_image at zlib compression level N
+ *    xform-NAME      png_read_image with one transform (non-interlaced images
+ *                    with adaptive filtering only, and only where the transform
+ *                    applies to the image)
+ *
+ * Each measurement is repeated until it has taken at least --time seconds and
+ * the fastest run is used.  The results are written as JSON, one result per
+ * line, giving the throughput in MB/s of uncompressed image data and in pixels
+ * per second.  A previous output file may be given with --baseline; any result
+ * more than --threshold percent slower than the baseline is listed on stderr
+ * and the exit status is then 1.
+ *
+ * This supersedes timepng, which only times png_read_row over existing files.
+ */
+#define _POSIX_C_SOURCE 199309L /* for clock_gettime */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+
+#if defined(HAVE_CONFIG_H) && !defined(PNG_NO_CONFIG_H)
+#  include <config.h>
+#endif
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* The following is to support direct compilation of this file as C++ */
+#ifdef __cplusplus
+#  define voidcast(type, value) static_cast<type>(value)
+#else
+#  define voidcast(type, value) (value)
+#endif /* __cplusplus */
+
+#if defined(CLOCK_MONOTONIC) && defined(PNG_SEQUENTIAL_READ_SUPPORTED) &&\
+    defined(PNG_PROGRESSIVE_READ_SUPPORTED) &&\
+    defined(PNG_SIMPLIFIED_READ_SUPPORTED) && defined(PNG_WRITE_SUPPORTED) &&\
+    defined(PNG_EASY_ACCESS_SUPPORTED) && defined(PNG_READ_TRANSFORMS_SUPPORTED)
+
+#define MAX_SIZES 8
+#define MAX_RESULTS 4096
+
+#include "pngmembuf.h"
+
+/* One image of the corpus */
+typedef struct
+{
+   char        name[64];
+   png_uint_32 width;
+   png_uint_32 height;
+   int         color_type;
+   int         bit_depth;
+   int         interlace;
+   int         filters;
+   size_t      rowbytes;
+   png_bytep   pixels;  /* height rows of rowbytes bytes, as written */
+   buffer      png;
+}  image;
+
+typedef struct
+{
+   char        name[128];
+   double      mb_per_s;
+   double      pixels_per_s;
+}  result;
+
+static result results[MAX_RESULTS];
+static int nresults = 0;
+
+static void
+fatal(const char *message, const char *detail)
+{
+   fprintf(stderr, "pngbench: %s%s%s\n", message, detail != NULL ? ": " : "",
+       detail != NULL ? detail : "");
+   exit(1);
+}
+
+static void *
+xmalloc(size_t size)
+{
+   void *p = malloc(size > 0 ? size : 1);
+
+   if (p == NULL)
+      fatal("out of memory", NULL);
+
+   return p;
+}
+
+static PNG_CALLBACK(void, bench_error, (png_structp png_ptr,
+    png_const_charp message))
+{
+   /* The corpus is generated by libpng, so any error is a bug. */
+   (void)png_ptr;
+   fatal("libpng error", message);
+}
+
+static PNG_CALLBACK(void, bench_warning, (png_structp png_ptr,
+    png_const_charp message))
+{
+   (void)png_ptr;
+   (void)message;
+}
+
+static double
+now(void)
+{
+   struct timespec t;
+
+   if (clock_gettime(CLOCK_MONOTONIC, &t) != 0)
+      fatal("clock_gettime failed", NULL);
+
+   return (double)t.tv_sec + (double)t.tv_nsec * 1E-9;
+}
+
+/* The image data is a gradient with some noise, so that it compresses to a
+ * realistic extent, generated with a fixed pseudo-random sequence.
+ */
+static png_uint_32 random_state;
+
+static unsigned int
+random_byte(void)
+{
+   random_state = random_state * 1103515245U + 12345U;
+   return (random_state >> 16) & 0xff;
+}
+
+static void
+encode_image(image *im, int level, buffer *out)
+{
+   png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
+       bench_error, bench_warning);
+   png_infop info_ptr;
+   png_bytepp rows;
+   png_uint_32 y;
+
+   if (png_ptr == NULL)
+      fatal("out of memory", NULL);
+
+   info_ptr = png_create_info_struct(png_ptr);
+   rows = voidcast(png_bytepp, xmalloc(im->height * (sizeof *rows)));
+
+   for (y = 0; y < im->height; ++y)
+      rows[y] = im->pixels + y * im->rowbytes;
+
+   out->size = 0;
+   png_set_write_fn(png_ptr, out, buffer_write, buffer_flush);
+   png_set_IHDR(png_ptr, info_ptr, im->width, im->height, im->bit_depth,
+       im->color_type, im->interlace, PNG_COMPRESSION_TYPE_BASE,
+       PNG_FILTER_TYPE_BASE);
+
+   if (im->color_type == PNG_COLOR_TYPE_PALETTE)
+   {
+      png_color palette[256];
+      int i, n = 1 << im->bit_depth;
+
+      for (i = 0; i < n; ++i)
+      {
+         palette[i].red = (png_byte)(i * 255 / (n - 1));
+         palette[i].green = (png_byte)(255 - palette[i].red);
+         palette[i].blue = (png_byte)(i * 37);
+      }
+
+      png_set_PLTE(png_ptr, info_ptr, palette, n);
+   }
+
+   png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, im->filters);
+   png_set_compression_level(png_ptr, level);
+   png_write_info(png_ptr, info_ptr);
+   png_write_image(png_ptr, rows);
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   free(rows);
+}
+
+static void
+make_image(image *im, png_uint_32 size, int color_type, int bit_depth,
+    int interlace, int filters)
+{
+   static const char *const color_names[] =
+      { "gray", "?", "rgb", "pal", "ga", "?", "rgba" };
+   int channels;
+   png_uint_32 x, y;
+
+   memset(im, 0, sizeof *im);
+   im->width = size;
+   im->height = size;
+   im->color_type = color_type;
+   im->bit_depth = bit_depth;
+   im->interlace = interlace;
+   im->filters = filters;
+
+   switch (color_type)
+   {
+      case PNG_COLOR_TYPE_RGB:        channels = 3; break;
+      case PNG_COLOR_TYPE_GRAY_ALPHA: channels = 2; break;
+      case PNG_COLOR_TYPE_RGB_ALPHA:  channels = 4; break;
+      default:                        channels = 1; break;
+   }
+
+   im->rowbytes = (size * channels * bit_depth + 7) >> 3;
+   im->pixels = voidcast(png_bytep, xmalloc(im->rowbytes * size));
+   sprintf(im->name, "%s%d/%lux%lu/%s/%s", color_names[color_type], bit_depth,
+       (unsigned long)size, (unsigned long)size,
+       interlace == PNG_INTERLACE_NONE ? "none" : "adam7",
+       filters == PNG_FILTER_NONE ? "nofilter" : "adaptive");
+
+   random_state = 1;
+
+   for (y = 0; y < size; ++y)
+   {
+      png_bytep row = im->pixels + y * im->rowbytes;
+
+      for (x = 0; x < im->rowbytes; ++x)
+         row[x] = (png_byte)((x + y) * 3 + (random_byte() & 0x0f));
+   }
+
+   encode_image(im, 6, &im->png);
+}
+
+/* Transforms benchmarked separately; 'applies' says which images they do
+ * something to.
+ */
+#define T_EXPAND        1
+#define T_STRIP_16      2
+#define T_SCALE_16      3
+#define T_GRAY_TO_RGB   4
+#define T_RGB_TO_GRAY   5
+#define T_BGR           6
+#define T_SWAP_ALPHA    7
+#define T_INVERT_ALPHA  8
+#define T_FILLER        9
+#define T_PACKING      10
+#define T_SWAP         11
+#define T_STRIP_ALPHA  12
+
+static const struct
+{
+   const char *name;
+   int         transform;
+}  transforms[] =
+{
+   { "expand",       T_EXPAND },
+   { "strip-16",     T_STRIP_16 },
+   { "scale-16",     T_SCALE_16 },
+   { "gray-to-rgb",  T_GRAY_TO_RGB },
+   { "rgb-to-gray",  T_RGB_TO_GRAY },
+   { "bgr",          T_BGR },
+   { "swap-alpha",   T_SWAP_ALPHA },
+   { "invert-alpha", T_INVERT_ALPHA },
+   { "filler",       T_FILLER },
+   { "packing",      T_PACKING },
+   { "swap",         T_SWAP },
+   { "strip-alpha",  T_STRIP_ALPHA }
+};
+
+#define NTRANSFORMS ((int)(sizeof transforms / sizeof transforms[0]))
+
+static int
+applies(const image *im, int transform)
+{
+   int color = (im->color_type & PNG_COLOR_MASK_COLOR) != 0 &&
+      im->color_type != PNG_COLOR_TYPE_PALETTE;
+   int alpha = (im->color_type & PNG_COLOR_MASK_ALPHA) != 0;
+
+   switch (transform)
+   {
+      case T_EXPAND:
+         return im->color_type == PNG_COLOR_TYPE_PALETTE || im->bit_depth < 8;
+
+      case T_STRIP_16:
+      case T_SCALE_16:
+      case T_SWAP:
+         return im->bit_depth == 16;
+
+      case T_GRAY_TO_RGB:
+         return (im->color_type & PNG_COLOR_MASK_COLOR) == 0;
+
+      case T_RGB_TO_GRAY:
+      case T_BGR:
+         return color;
+
+      case T_SWAP_ALPHA:
+      case T_INVERT_ALPHA:
+      case T_STRIP_ALPHA:
+         return alpha;
+
+      case T_FILLER:
+         return !alpha && im->color_type != PNG_COLOR_TYPE_PALETTE &&
+            im->bit_depth >= 8;
+
+      case T_PACKING:
+         return im->bit_depth < 8;
+
+      default:
+         return 0;
+   }
+}
+
+static void
+set_transform(png_structp png_ptr, int transform)
+{
+   switch (transform)
+   {
+      case T_EXPAND:       png_set_expand(png_ptr); break;
+      case T_STRIP_16:     png_set_strip_16(png_ptr); break;
+      case T_SCALE_16:     png_set_scale_16(png_ptr); break;
+      case T_GRAY_TO_RGB:  png_set_gray_to_rgb(png_ptr); break;
+      case T_RGB_TO_GRAY:  png_set_rgb_to_gray_fixed(png_ptr, 1, -1, -1);
+                           break;
+      case T_BGR:          png_set_bgr(png_ptr); break;
+      case T_SWAP_ALPHA:   png_set_swap_alpha(png_ptr); break;
+      case T_INVERT_ALPHA: png_set_invert_alpha(png_ptr); break;
+      case T_FILLER:       png_set_filler(png_ptr, 0xffff, PNG_FILLER_AFTER);
+                           break;
+      case T_PACKING:      png_set_packing(png_ptr); break;
+      case T_SWAP:         png_set_swap(png_ptr); break;
+      case T_STRIP_ALPHA:  png_set_strip_alpha(png_ptr); break;
+      default:             break;
+   }
+}
+
+/* The output buffer of the read benchmarks; reused to avoid timing malloc. */
+static png_bytep output;
+static size_t output_size;
+static png_bytepp output_rows;
+static png_uint_32 output_nrows;
+
+static void
+output_buffer(png_uint_32 height, size_t rowbytes)
+{
+   png_uint_32 y;
+
+   if (height * rowbytes > output_size)
+   {
+      free(output);
+      output_size = height * rowbytes;
+      output = voidcast(png_bytep, xmalloc(output_size));
+   }
+
+   if (height > output_nrows)
+   {
+      free(output_rows);
+      output_nrows = height;
+      output_rows = voidcast(png_bytepp,
+          xmalloc(height * (sizeof *output_rows)));
+   }
+
+   for (y = 0; y < height; ++y)
+      output_rows[y] = output + y * rowbytes;
+}
+
+static void
+read_image(image *im, int transform, int trusted)
+{
+   png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+       bench_error, bench_warning);
+   png_infop info_ptr;
+
+   if (png_ptr == NULL)
+      fatal("out of memory", NULL);
+
+   info_ptr = png_create_info_struct(png_ptr);
+   im->png.read = 0;
+   png_set_read_fn(png_ptr, &im->png, buffer_read);
+
+   if (trusted != 0)
+      png_set_trusted_input(png_ptr, 1);
+
+   png_read_info(png_ptr, info_ptr);
+
+   if (transform != 0)
+      set_transform(png_ptr, transform);
+
+   (void)png_set_interlace_handling(png_ptr);
+   png_read_update_info(png_ptr, info_ptr);
+   output_buffer(im->height, png_get_rowbytes(png_ptr, info_ptr));
+   png_read_image(png_ptr, output_rows);
+   png_read_end(png_ptr, NULL);
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+static void
+read_sequential(image *im, int transform)
+{
+   read_image(im, transform, 0);
+}
+
+static void
+read_trusted(image *im, int transform)
+{
+   read_image(im, transform, 1);
+}
+
+static PNG_CALLBACK(void, push_info, (png_structp png_ptr, png_infop info_ptr))
+{
+   (void)png_set_interlace_handling(png_ptr);
+   png_read_update_info(png_ptr, info_ptr);
+   output_buffer(png_get_image_height(png_ptr, info_ptr),
+       png_get_rowbytes(png_ptr, info_ptr));
+}
+
+static PNG_CALLBACK(void, push_row, (png_structp png_ptr, png_bytep row,
+    png_uint_32 row_num, int pass))
+{
+   (void)pass;
+
+   if (row != NULL)
+      png_progressive_combine_row(png_ptr, output_rows[row_num], row);
+}
+
+static void
+read_progressive(image *im, int transform)
+{
+   png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+       bench_error, bench_warning);
+   png_infop info_ptr;
+   size_t pos;
+
+   if (png_ptr == NULL)
+      fatal("out of memory", NULL);
+
+   info_ptr = png_create_info_struct(png_ptr);
+   png_set_progressive_read_fn(png_ptr, NULL, push_info, push_row, NULL);
+   (void)transform;
+
+   for (pos = 0; pos < im->png.size; pos += 65536)
+   {
+      size_t size = im->png.size - pos;
+
+      if (size > 65536)
+         size = 65536;
+
+      png_process_data(png_ptr, info_ptr, im->png.data + pos, size);
+   }
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+static void
+read_simplified(image *im, int transform)
+{
+   png_image image;
+
+   (void)transform;
+   memset(&image, 0, sizeof image);
+   image.version = PNG_IMAGE_VERSION;
+
+   if (!png_image_begin_read_from_memory(&image, im->png.data, im->png.size))
+      fatal("simplified read", image.message);
+
+   image.format = PNG_FORMAT_RGBA;
+   output_buffer(1, PNG_IMAGE_SIZE(image));
+
+   if (!png_image_finish_read(&image, NULL, output, 0, NULL))
+      fatal("simplified read", image.message);
+}
+
+static buffer write_output;
+
+static void
+write_level(image *im, int level)
+{
+   encode_image(im, level, &write_output);
+}
+
+static double min_time = 0.1;
+static const char *select_name = NULL;
+
+/* Time fn(im, arg) and record the result under 'name'. */
+static void
+measure(const char *name, image *im, void (*fn)(image*, int), int arg)
+{
+   double best = 0, total = 0;
+   int runs = 0;
+   result *r;
+
+   if (select_name != NULL && strstr(name, select_name) == NULL)
+      return;
+
+   if (nresults >= MAX_RESULTS)
+      fatal("too many results", name);
+
+   do
+   {
+      double start = now(), elapsed;
+
+      fn(im, arg);
+      elapsed = now() - start;
+
+      if (runs == 0 || elapsed < best)
+         best = elapsed;
+
+      total += elapsed;
+      ++runs;
+   }
+   while (total < min_time);
+
+   if (best <= 0)
+      best = 1E-9;
+
+   r = results + nresults++;
+   strncpy(r->name, name, (sizeof r->name) - 1);
+   r->name[(sizeof r->name) - 1] = 0;
+   r->mb_per_s = (double)im->rowbytes * im->height / best / 1E6;
+   r->pixels_per_s = (double)im->width * im->height / best;
+}
+
+static void
+benchmark(image *im)
+{
+   static const int levels[] = { 1, 6, 9 };
+   char name[128];
+   int i;
+
+   sprintf(name, "read-seq/%s", im->name);
+   measure(name, im, read_sequential, 0);
+   sprintf(name, "read-trusted/%s", im->name);
+   measure(name, im, read_trusted, 0);
+   sprintf(name, "read-push/%s", im->name);
+   measure(name, im, read_progressive, 0);
+   sprintf(name, "read-simple/%s", im->name);
+   measure(name, im, read_simplified, 0);
+
+   for (i = 0; i < (int)(sizeof levels / sizeof levels[0]); ++i)
+   {
+      sprintf(name, "write-l%d/%s", levels[i], im->name);
+      measure(name, im, write_level, levels[i]);
+   }
+
+   if (im->interlace == PNG_INTERLACE_NONE && im->filters != PNG_FILTER_NONE)
+   {
+      for (i = 0; i < NTRANSFORMS; ++i)
+      {
+         if (applies(im, transforms[i].transform))
+         {
+            sprintf(name, "xform-%s/%s", transforms[i].name, im->name);
+            measure(name, im, read_sequential, transforms[i].transform);
+         }
+      }
+   }
+}
+
+static void
+write_json(FILE *out)
+{
+   int i;
+
+   fprintf(out, "{\n  \"libpng\": \"%s\",\n  \"results\": [\n",
+       PNG_LIBPNG_VER_STRING);
+
+   for (i = 0; i < nresults; ++i)
+      fprintf(out, "    {\"name\": \"%s\", \"mb_per_s\": %.3f,"
+          " \"pixels_per_s\": %.0f}%s\n", results[i].name,
+          results[i].mb_per_s, results[i].pixels_per_s,
+          i+1 < nresults ? "," : "");
+
+   fprintf(out, "  ]\n}\n");
+}
+
+/* Read a file written by write_json and compare the results; this only
+ * understands the format written above.  Returns the number of regressions.
+ */
+static int
+compare_baseline(const char *file_name, double threshold)
+{
+   FILE *fp = fopen(file_name, "r");
+   char line[512];
+   int regressions = 0, compared = 0;
+
+   if (fp == NULL)
+      fatal("cannot open baseline", file_name);
+
+   while (fgets(line, sizeof line, fp) != NULL)
+   {
+      char *name = strstr(line, "\"name\": \"");
+      char *speed = strstr(line, "\"mb_per_s\": ");
+
+      if (name != NULL && speed != NULL)
+      {
+         char *end;
+         double baseline;
+         int i;
+
+         name += 9;
+         end = strchr(name, '"');
+
+         if (end == NULL)
+            continue;
+
+         *end = 0;
+         baseline = atof(speed + 12);
+
+         for (i = 0; i < nresults; ++i)
+         {
+            if (strcmp(results[i].name, name) == 0)
+            {
+               double change = (results[i].mb_per_s - baseline) * 100 /
+                  baseline;
+
+               ++compared;
+
+               if (change < -threshold)
+               {
+                  fprintf(stderr, "pngbench: %s: %.3f MB/s, baseline %.3f"
+                      " (%+.1f%%)\n", name, results[i].mb_per_s, baseline,
+                      change);
+                  ++regressions;
+               }
+
+               break;
+            }
+         }
+      }
+   }
+
+   fclose(fp);
+   fprintf(stderr, "pngbench: %d results compared with %s, %d regressions"
+       " beyond %.1f%%\n", compared, file_name, regressions, threshold);
+   return regressions;
+}
+
+static void
+usage(const char *prog)
+{
+   fprintf(stderr,
+"Usage: %s [options]\n"
+"  --sizes=N[,N...]   image sizes (width and height) to generate [256]\n"
+"  --time=SECONDS     minimum time for each measurement [0.1]\n"
+"  --select=STRING    only run the benchmarks whose name contains STRING\n"
+"  --output=FILE      write the JSON results to FILE rather than stdout\n"
+"  --baseline=FILE    compare with the JSON results in FILE\n"
+"  --threshold=PCT    slow-down reported as a regression [10]\n"
+"  --quick            --sizes=64 --time=0.01, to check that it works\n",
+      prog);
+   exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+   static const struct { int color_type, bit_depth; } formats[] =
+   {
+      { PNG_COLOR_TYPE_GRAY, 1 }, { PNG_COLOR_TYPE_GRAY, 2 },
+      { PNG_COLOR_TYPE_GRAY, 4 }, { PNG_COLOR_TYPE_GRAY, 8 },
+      { PNG_COLOR_TYPE_GRAY, 16 },
+      { PNG_COLOR_TYPE_GRAY_ALPHA, 8 }, { PNG_COLOR_TYPE_GRAY_ALPHA, 16 },
+      { PNG_COLOR_TYPE_RGB, 8 }, { PNG_COLOR_TYPE_RGB, 16 },
+      { PNG_COLOR_TYPE_RGB_ALPHA, 8 }, { PNG_COLOR_TYPE_RGB_ALPHA, 16 },
+      { PNG_COLOR_TYPE_PALETTE, 1 }, { PNG_COLOR_TYPE_PALETTE, 2 },
+      { PNG_COLOR_TYPE_PALETTE, 4 }, { PNG_COLOR_TYPE_PALETTE, 8 }
+   };
+   png_uint_32 sizes[MAX_SIZES];
+   int nsizes = 0, f, s, interlace, filtered, regressions = 0;
+   const char *output_name = NULL, *baseline_name = NULL;
+   double threshold = 10;
+   FILE *out = stdout;
+
+   for (f = 1; f < argc; ++f)
+   {
+      const char *arg = argv[f];
+
+      if (strncmp(arg, "--sizes=", 8) == 0)
+      {
+         const char *p = arg + 8;
+
+         nsizes = 0;
+
+         while (*p != 0 && nsizes < MAX_SIZES)
+         {
+            char *end;
+            unsigned long size = strtoul(p, &end, 10);
+
+            if (end == p || size == 0 || size > 16384 ||
+                (*end != 0 && *end != ','))
+               usage(argv[0]);
+
+            sizes[nsizes++] = (png_uint_32)size;
+            p = *end == ',' ? end + 1 : end;
+         }
+      }
+
+      else if (strncmp(arg, "--time=", 7) == 0)
+         min_time = atof(arg + 7);
+
+      else if (strncmp(arg, "--select=", 9) == 0)
+         select_name = arg + 9;
+
+      else if (strncmp(arg, "--output=", 9) == 0)
+         output_name = arg + 9;
+
+      else if (strncmp(arg, "--baseline=", 11) == 0)
+         baseline_name = arg + 11;
+
+      else if (strncmp(arg, "--threshold=", 12) == 0)
+         threshold = atof(arg + 12);
+
+      else if (strcmp(arg, "--quick") == 0)
+      {
+         sizes[0] = 64;
+         nsizes = 1;
+         min_time = 0.01;
+      }
+
+      else
+         usage(argv[0]);
+   }
+
+   if (nsizes == 0)
+   {
+      sizes[0] = 256;
+      nsizes = 1;
+   }
+
+   for (s = 0; s < nsizes; ++s)
+      for (f = 0; f < (int)(sizeof formats / sizeof formats[0]); ++f)
+         for (interlace = 0; interlace <= 1; ++interlace)
+            for (filtered = 0; filtered <= 1; ++filtered)
+            {
+               image im;
+
+               make_image(&im, sizes[s], formats[f].color_type,
+                   formats[f].bit_depth,
+                   interlace ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+                   filtered ? PNG_ALL_FILTERS : PNG_FILTER_NONE);
+               benchmark(&im);
+               free(im.pixels);
+               free(im.png.data);
+            }
+
+   if (output_name != NULL)
+   {
+      out = fopen(output_name, "w");
+
+      if (out == NULL)
+         fatal("cannot create output", output_name);
+   }
+
+   write_json(out);
+
+   if (out != stdout && fclose(out) != 0)
+      fatal("error writing output", output_name);
+
+   if (baseline_name != NULL)
+      regressions = compare_baseline(baseline_name, threshold);
+
+   free(output);
+   free(output_rows);
+   free(write_output.data);
+
+   return regressions > 0;
+}
+#else /* !sufficient support */
+int main(void) { return 77; }
+#endif /* !sufficient support */
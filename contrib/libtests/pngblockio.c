@@ -0,0 +1,513 @@
+/* pngblockio.c - test the read-ahead and write buffering I/O
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  It
+ *   writes an RGB image with several IDAT chunks to memory, then checks that:
+ *
+ *   1) png_set_read_ahead_fn reads the same pixels as an ordinary read
+ *      function, with fewer calls, for buffers smaller and larger than a chunk
+ *      and for a function that returns less than it is asked for,
+ *   2) reading stops at the IEND CRC, leaving data that follows the PNG in the
+ *      input,
+ *   3) png_set_read_fn and png_set_read_ahead_fn can be called part way
+ *      through the read without data read ahead being returned again, and
+ *   4) png_set_write_buffer_size writes the same bytes as unbuffered output
+ *      for buffers smaller and larger than a chunk and that png_write_flush
+ *      writes out everything buffered before calling the flush function.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_SEQUENTIAL_READ_SUPPORTED) && defined(PNG_WRITE_SUPPORTED)
+
+#define WIDTH  61
+#define HEIGHT 47
+#define ROWBYTES (WIDTH * 3)
+
+#include "pngmembuf.h"
+
+static png_byte image[HEIGHT][ROWBYTES];
+
+/* The input with counts of the calls made to read it.  'file' must be first;
+ * buffer_read uses the io_ptr as a buffer.
+ */
+typedef struct
+{
+   buffer        file;
+   size_t        max_return; /* most bytes returned by one call, 0: no limit */
+   unsigned long calls;
+   size_t        bytes;
+} source;
+
+/* The output with a count of the write calls.  'file' must be first. */
+typedef struct
+{
+   buffer        file;
+   unsigned long calls;
+   unsigned long flushes;
+   int           bad_flush;  /* a flush did not end at a chunk boundary */
+} sink;
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   fprintf(stderr, "pngblockio: %s\n", message);
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)png_ptr;
+   (void)message;
+}
+
+static void PNGCBAPI
+counting_read(png_structp png_ptr, png_bytep data, size_t size)
+{
+   source *s = (source*)png_get_io_ptr(png_ptr);
+
+   buffer_read(png_ptr, data, size);
+   s->calls++;
+   s->bytes += size;
+}
+
+static size_t PNGCBAPI
+counting_read_ahead(png_structp png_ptr, png_bytep data, size_t size)
+{
+   source *s = (source*)png_get_io_ptr(png_ptr);
+   size_t avail = s->file.size - s->file.read;
+
+   if (size > avail)
+      size = avail;
+
+   if (s->max_return > 0 && size > s->max_return)
+      size = s->max_return;
+
+   memcpy(data, s->file.data + s->file.read, size);
+   s->file.read += size;
+   s->calls++;
+   s->bytes += size;
+   return size;
+}
+
+static void PNGCBAPI
+counting_write(png_structp png_ptr, png_bytep data, size_t size)
+{
+   sink *s = (sink*)png_get_io_ptr(png_ptr);
+
+   buffer_write(png_ptr, data, size);
+   s->calls++;
+}
+
+/* Return the offset of the first chunk of the given type, or of the end of
+ * the chunks if there is no such chunk.
+ */
+static size_t
+chunk_offset(const buffer *b, const char *type)
+{
+   size_t offset = 8;
+
+   while (offset + 8 <= b->size)
+   {
+      png_const_bytep p = b->data + offset;
+
+      if (memcmp(p + 4, type, 4) == 0)
+         break;
+
+      offset += 12 + png_get_uint_32(p);
+   }
+
+   return offset;
+}
+
+static void PNGCBAPI
+checking_flush(png_structp png_ptr)
+{
+   sink *s = (sink*)png_get_io_ptr(png_ptr);
+
+   /* Everything written so far must have reached the write function, which
+    * means that the output ends with a complete chunk.
+    */
+   if (chunk_offset(&s->file, "\0\0\0\0") != s->file.size)
+      s->bad_flush = 1;
+
+   s->flushes++;
+}
+
+static void
+make_image(void)
+{
+   png_uint_32 x, y;
+   png_uint_32 h = 1;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < ROWBYTES; ++x)
+      {
+         h = h * 1103515245U + 12345U;
+         image[y][x] = (png_byte)((h >> 24) & 0x3f) + (png_byte)(x + y);
+      }
+}
+
+/* Write the image with the given write buffer size, flushing every
+ * 'flush_rows' rows if that is not 0.  Returns 0 on success.
+ */
+static int
+write_png(sink *s, size_t buffer_size, int flush_rows)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_text text;
+   volatile int ok = 0;
+
+   memset(s, 0, sizeof *s);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_uint_32 y;
+
+      png_set_write_fn(png_ptr, s, counting_write, checking_flush);
+      png_set_write_buffer_size(png_ptr, buffer_size);
+
+      /* About 500 bytes of image data per IDAT */
+      png_set_compression_buffer_size(png_ptr, 512);
+      png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+         PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+      memset(&text, 0, sizeof text);
+      text.compression = PNG_TEXT_COMPRESSION_NONE;
+      text.key = (png_charp)"Comment";
+      text.text = (png_charp)"pngblockio";
+      png_set_text(png_ptr, info_ptr, &text, 1);
+      png_write_info(png_ptr, info_ptr);
+
+#     ifdef PNG_WRITE_FLUSH_SUPPORTED
+      if (flush_rows > 0)
+         png_set_flush(png_ptr, flush_rows);
+#     else
+      (void)flush_rows;
+#     endif
+
+      for (y = 0; y < HEIGHT; ++y)
+         png_write_row(png_ptr, image[y]);
+
+      png_write_end(png_ptr, info_ptr);
+      ok = 1;
+   }
+
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   return !ok;
+}
+
+/* How to read the file */
+#define READ_PLAIN        0 /* png_set_read_fn */
+#define READ_AHEAD        1 /* png_set_read_ahead_fn */
+#define READ_SWITCH_PLAIN 2 /* read-ahead, then png_set_read_fn after the info */
+#define READ_SWITCH_AHEAD 3 /* read-ahead, then png_set_read_ahead_fn again */
+
+/* Read the PNG in s->file and compare the pixels with 'image'.  Returns 0 on
+ * success.
+ */
+static int
+read_png(source *s, int how, size_t buffer_size)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_byte row[ROWBYTES];
+   volatile int ok = 0;
+
+   s->file.read = 0;
+   s->calls = 0;
+   s->bytes = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_uint_32 y;
+
+      if (how == READ_PLAIN)
+         png_set_read_fn(png_ptr, s, counting_read);
+
+      else
+         png_set_read_ahead_fn(png_ptr, s, counting_read_ahead, buffer_size);
+
+      png_read_info(png_ptr, info_ptr);
+
+      if (how == READ_SWITCH_PLAIN || how == READ_SWITCH_AHEAD)
+      {
+         /* png_read_info stops after the first IDAT header; any data read
+          * beyond that is discarded, so continue from there.
+          */
+         s->file.read = chunk_offset(&s->file, "IDAT") + 8;
+
+         if (how == READ_SWITCH_PLAIN)
+            png_set_read_fn(png_ptr, s, counting_read);
+
+         else
+            png_set_read_ahead_fn(png_ptr, s, counting_read_ahead, 7);
+      }
+
+      for (y = 0; y < HEIGHT; ++y)
+      {
+         png_read_row(png_ptr, row, NULL);
+
+         if (memcmp(row, image[y], ROWBYTES) != 0)
+            png_error(png_ptr, "pixels differ");
+      }
+
+      png_read_end(png_ptr, NULL);
+      ok = 1;
+   }
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return !ok;
+}
+
+static int
+test_read(const buffer *png)
+{
+   static const char trailer[] = "data after the PNG";
+   source s;
+   unsigned long plain_calls;
+   int errors = 0;
+   int i;
+   static const struct
+   {
+      const char *name;
+      size_t      buffer_size;
+      size_t      max_return;
+   } ahead[] =
+   {
+      { "default buffer", 0, 0 },
+      { "small buffer", 16, 0 },
+      { "large buffer", 100000, 0 },
+      { "short reads", 4096, 100 }
+   };
+
+   /* The PNG followed by data that libpng must not read */
+   memset(&s, 0, sizeof s);
+   s.file.size = png->size + (sizeof trailer);
+   s.file.data = (png_bytep)malloc(s.file.size);
+
+   if (s.file.data == NULL)
+      return 1;
+
+   memcpy(s.file.data, png->data, png->size);
+   memcpy(s.file.data + png->size, trailer, sizeof trailer);
+
+   if (read_png(&s, READ_PLAIN, 0) != 0)
+   {
+      fprintf(stderr, "pngblockio: plain read failed\n");
+      ++errors;
+   }
+
+   plain_calls = s.calls;
+
+   for (i = 0; i < (int)(sizeof ahead / sizeof ahead[0]); ++i)
+   {
+      s.max_return = ahead[i].max_return;
+
+      if (read_png(&s, READ_AHEAD, ahead[i].buffer_size) != 0)
+      {
+         fprintf(stderr, "pngblockio: read-ahead, %s: read failed\n",
+            ahead[i].name);
+         ++errors;
+         continue;
+      }
+
+      if (s.bytes != png->size)
+      {
+         fprintf(stderr, "pngblockio: read-ahead, %s: read %lu bytes of a %lu"
+            " byte PNG\n", ahead[i].name, (unsigned long)s.bytes,
+            (unsigned long)png->size);
+         ++errors;
+      }
+
+      /* Short reads may need more calls */
+      if (s.max_return == 0 && s.calls >= plain_calls)
+      {
+         fprintf(stderr, "pngblockio: read-ahead, %s: %lu calls, %lu without"
+            " read-ahead\n", ahead[i].name, s.calls, plain_calls);
+         ++errors;
+      }
+   }
+
+   s.max_return = 0;
+
+   if (read_png(&s, READ_SWITCH_PLAIN, 0) != 0)
+   {
+      fprintf(stderr, "pngblockio: png_set_read_fn part way: read failed\n");
+      ++errors;
+   }
+
+   if (read_png(&s, READ_SWITCH_AHEAD, 0) != 0)
+   {
+      fprintf(stderr,
+         "pngblockio: png_set_read_ahead_fn part way: read failed\n");
+      ++errors;
+   }
+
+   free(s.file.data);
+   return errors;
+}
+
+static int
+test_write(const sink *plain)
+{
+   sink s;
+   int errors = 0;
+   int i;
+   static const struct
+   {
+      const char *name;
+      size_t      buffer_size;
+   } sizes[] =
+   {
+      { "small buffer", 16 },  /* smaller than the IDAT chunks */
+      { "large buffer", 1U << 20 } /* larger than the whole file */
+   };
+
+   for (i = 0; i < (int)(sizeof sizes / sizeof sizes[0]); ++i)
+   {
+      if (write_png(&s, sizes[i].buffer_size, 0) != 0)
+      {
+         fprintf(stderr, "pngblockio: write, %s: write failed\n",
+            sizes[i].name);
+         ++errors;
+      }
+
+      else if (s.file.size != plain->file.size ||
+          memcmp(s.file.data, plain->file.data, s.file.size) != 0)
+      {
+         fprintf(stderr, "pngblockio: write, %s: output differs\n",
+            sizes[i].name);
+         ++errors;
+      }
+
+      else if (s.calls >= plain->calls ||
+          (sizes[i].buffer_size > plain->file.size && s.calls != 1))
+      {
+         fprintf(stderr, "pngblockio: write, %s: %lu calls, %lu unbuffered\n",
+            sizes[i].name, s.calls, plain->calls);
+         ++errors;
+      }
+
+      free(s.file.data);
+
+#     ifdef PNG_WRITE_FLUSH_SUPPORTED
+      /* Flushed output differs, so it is checked by reading it back */
+      if (write_png(&s, sizes[i].buffer_size, 8) != 0)
+      {
+         fprintf(stderr, "pngblockio: flush, %s: write failed\n",
+            sizes[i].name);
+         ++errors;
+      }
+
+      else
+      {
+         source in;
+
+         memset(&in, 0, sizeof in);
+         in.file = s.file;
+
+         if (s.flushes < HEIGHT / 8 || s.bad_flush)
+         {
+            fprintf(stderr, "pngblockio: flush, %s: %lu flushes%s\n",
+               sizes[i].name, s.flushes,
+               s.bad_flush ? ", data left in the buffer" : "");
+            ++errors;
+         }
+
+         if (read_png(&in, READ_PLAIN, 0) != 0)
+         {
+            fprintf(stderr, "pngblockio: flush, %s: read back failed\n",
+               sizes[i].name);
+            ++errors;
+         }
+      }
+
+      free(s.file.data);
+#     endif
+   }
+
+   return errors;
+}
+
+int
+main(void)
+{
+   sink plain;
+   int errors = 0;
+
+   make_image();
+
+   if (write_png(&plain, 0, 0) != 0)
+   {
+      fprintf(stderr, "pngblockio: failed to write test image\n");
+      return 1;
+   }
+
+   /* The image must be in several IDAT chunks */
+   if (chunk_offset(&plain.file, "IDAT") + 1000 > plain.file.size)
+   {
+      fprintf(stderr, "pngblockio: test image too small\n");
+      return 1;
+   }
+
+   errors += test_read(&plain.file);
+   errors += test_write(&plain);
+   free(plain.file.data);
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pngblockio: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(SEQUENTIAL_READ && WRITE) */
+int
+main(void)
+{
+   fprintf(stderr,
+      " test ignored: no support to read sequentially and write\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
@@ -0,0 +1,351 @@
+/* pngframe.c - test the frame buffer of the progressive reader
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  It
+ *   writes an RGB image, interlaced and not, to memory and feeds it to the
+ *   progressive reader a few bytes at a time with png_set_progressive_frame.
+ *   For both display methods it checks that:
+ *
+ *   1) the frame function is called once for each pass, with the passes in
+ *      increasing order,
+ *   2) after each pass of the sparkle method the pixels of the passes so far
+ *      are set and the others are unchanged,
+ *   3) after the first pass of the rectangle method each 8x8 block holds its
+ *      top left pixel, and
+ *   4) the frame buffer holds the whole image after the last pass.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_PROGRESSIVE_READ_SUPPORTED) &&\
+   defined(PNG_READ_INTERLACING_SUPPORTED) &&\
+   defined(PNG_WRITE_INTERLACING_SUPPORTED)
+
+/* Not a multiple of 8, so that the last blocks are partial */
+#define WIDTH  37
+#define HEIGHT 29
+#define ROWBYTES (WIDTH * 3)
+#define UNSET  0  /* no pixel of the image has a zero component */
+
+#include "pngmembuf.h"
+
+static png_byte image[HEIGHT][ROWBYTES];
+
+/* The state of one read */
+typedef struct
+{
+   int          display;   /* PNG_FRAME_ method */
+   int          interlaced;
+   png_byte     frame[HEIGHT][ROWBYTES];
+   png_bytep    rows[HEIGHT];
+   int          num_frames;
+   int          last_pass;
+   int          errors;
+} reader;
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   fprintf(stderr, "pngframe: %s\n", message);
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+expected_error_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)message;
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)png_ptr;
+   (void)message;
+}
+
+static void
+make_image(void)
+{
+   png_uint_32 x, y;
+   png_uint_32 h = 1;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < ROWBYTES; ++x)
+      {
+         h = h * 1103515245U + 12345U;
+         image[y][x] = (png_byte)((h >> 24) | 1);
+      }
+}
+
+static void
+write_png(buffer *b, int interlace)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   int pass, num_passes;
+
+   memset(b, 0, sizeof *b);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngframe: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      fprintf(stderr, "pngframe: failed to write test image\n");
+      exit(1);
+   }
+
+   png_set_write_fn(png_ptr, b, buffer_write, buffer_flush);
+   png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+      interlace, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+   png_write_info(png_ptr, info_ptr);
+   num_passes = png_set_interlace_handling(png_ptr);
+
+   for (pass = 0; pass < num_passes; ++pass)
+      for (y = 0; y < HEIGHT; ++y)
+         png_write_row(png_ptr, image[y]);
+
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+}
+
+/* The pass the pixel at x,y is in */
+static int
+pixel_pass(png_uint_32 x, png_uint_32 y)
+{
+   int pass;
+
+   for (pass = 0; pass < 6; ++pass)
+      if (PNG_ROW_IN_INTERLACE_PASS(y, pass) &&
+          PNG_COL_IN_INTERLACE_PASS(x, pass))
+         break;
+
+   return pass;
+}
+
+static int
+same_pixel(png_const_bytep a, png_const_bytep b)
+{
+   return memcmp(a, b, 3) == 0;
+}
+
+static void
+check_frame(reader *r, int pass)
+{
+   png_uint_32 x, y;
+   int bad = 0;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < WIDTH; ++x)
+      {
+         png_const_bytep p = r->frame[y] + 3*x;
+
+         if (!r->interlaced || pass == 6)
+            bad |= !same_pixel(p, image[y] + 3*x);
+
+         else if (r->display == PNG_FRAME_SPARKLE)
+         {
+            if (pixel_pass(x, y) <= pass)
+               bad |= !same_pixel(p, image[y] + 3*x);
+
+            else
+               bad |= p[0] != UNSET || p[1] != UNSET || p[2] != UNSET;
+         }
+
+         else if (pass == 0)
+            bad |= !same_pixel(p, image[y & ~7U] + 3*(x & ~7U));
+
+         /* Every pixel has been set by the rectangle method */
+         else
+            bad |= p[0] == UNSET;
+      }
+
+   if (bad)
+   {
+      fprintf(stderr, "pngframe: %s %s, pass %d: frame buffer wrong\n",
+         r->interlaced ? "interlaced" : "non-interlaced",
+         r->display == PNG_FRAME_SPARKLE ? "sparkle" : "rectangle", pass);
+      ++r->errors;
+   }
+}
+
+static void PNGCBAPI
+frame_fn(png_structp png_ptr, int pass)
+{
+   reader *r = (reader*)png_get_progressive_ptr(png_ptr);
+
+   if (pass <= r->last_pass)
+   {
+      fprintf(stderr, "pngframe: pass %d after pass %d\n", pass,
+         r->last_pass);
+      ++r->errors;
+   }
+
+   r->last_pass = pass;
+   ++r->num_frames;
+   check_frame(r, pass);
+}
+
+static void PNGCBAPI
+info_fn(png_structp png_ptr, png_infop info_ptr)
+{
+   reader *r = (reader*)png_get_progressive_ptr(png_ptr);
+
+   (void)png_set_interlace_handling(png_ptr);
+   png_read_update_info(png_ptr, info_ptr);
+   png_set_progressive_frame(png_ptr, r->rows, r->display, frame_fn);
+}
+
+static int
+read_png(const buffer *b, int interlaced, int display)
+{
+   static reader r;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   int expect = interlaced ? 7 : 1;
+
+   memset(&r, 0, sizeof r);
+   r.display = display;
+   r.interlaced = interlaced;
+   r.last_pass = -1;
+   memset(r.frame, UNSET, sizeof r.frame);
+
+   for (y = 0; y < HEIGHT; ++y)
+      r.rows[y] = r.frame[y];
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      size_t i;
+
+      png_set_progressive_read_fn(png_ptr, &r, info_fn, NULL, NULL);
+
+      /* Small pieces, so that passes end part way through a piece */
+      for (i = 0; i < b->size; i += 7)
+      {
+         size_t size = b->size - i;
+
+         png_process_data(png_ptr, info_ptr, b->data + i, size < 7 ? size : 7);
+      }
+   }
+
+   else
+      ++r.errors;
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+   if (r.num_frames != expect)
+   {
+      fprintf(stderr, "pngframe: %d frames, expected %d\n", r.num_frames,
+         expect);
+      ++r.errors;
+   }
+
+   return r.errors;
+}
+
+/* png_set_progressive_frame must reject an unknown display method */
+static int
+check_invalid_display(void)
+{
+   png_structp png_ptr;
+   png_bytep rows[1];
+   volatile int errors = 1;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+      expected_error_fn, warning_fn);
+
+   if (png_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+#     ifdef PNG_BENIGN_ERRORS_SUPPORTED
+      png_set_benign_errors(png_ptr, 0/*error*/);
+#     endif
+      png_set_progressive_frame(png_ptr, rows, 2, NULL);
+      fprintf(stderr, "pngframe: display 2 accepted\n");
+   }
+
+   else
+      errors = 0;
+
+   png_destroy_read_struct(&png_ptr, NULL, NULL);
+   return errors;
+}
+
+int
+main(void)
+{
+   buffer plain, interlaced;
+   int errors = 0;
+
+   make_image();
+   write_png(&plain, PNG_INTERLACE_NONE);
+   write_png(&interlaced, PNG_INTERLACE_ADAM7);
+
+   errors += read_png(&plain, 0, PNG_FRAME_RECTANGLE);
+   errors += read_png(&plain, 0, PNG_FRAME_SPARKLE);
+   errors += read_png(&interlaced, 1, PNG_FRAME_RECTANGLE);
+   errors += read_png(&interlaced, 1, PNG_FRAME_SPARKLE);
+   errors += check_invalid_display();
+
+   free(plain.data);
+   free(interlaced.data);
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pngframe: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(PROGRESSIVE_READ && READ_INTERLACING && WRITE_INTERLACING) */
+int
+main(void)
+{
+   fprintf(stderr, " test ignored: no progressive interlaced read support\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
@@ -0,0 +1,538 @@
+/* pngidat.c - test reading IDAT chunks of different sizes
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  It
+ *   writes an RGB image to memory once as a single large IDAT chunk and once
+ *   as many tiny IDAT chunks, then checks that the same pixels are read:
+ *
+ *   1) by the sequential reader with an ordinary read function, which reads
+ *      IDAT data through a buffer,
+ *   2) by the sequential reader with png_set_read_ahead_fn and by the
+ *      simplified API reading from memory, which inflate the IDAT data where
+ *      it is, and
+ *   3) with the PNG_ADAPTIVE_IDAT_READ option on and off, where the option
+ *      must reduce the calls to the read function for the large chunk.
+ *
+ *   It also checks the IDAT chunks written with png_set_IDAT_chunk_size: the
+ *   number and size of the chunks for sizes below, above and far above the
+ *   compression buffer size, that sizes 1 to 5 are rejected, that the call is
+ *   an application error on a read struct and that png_image_write_to_memory
+ *   writes a single IDAT chunk.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_SEQUENTIAL_READ_SUPPORTED) && defined(PNG_WRITE_SUPPORTED) &&\
+   defined(PNG_SET_OPTION_SUPPORTED) && defined(PNG_SIMPLIFIED_READ_SUPPORTED)
+
+/* Random pixels, so the compressed data is much bigger than the buffer the
+ * sequential reader normally reads IDAT data into.
+ */
+#define WIDTH  128
+#define HEIGHT 96
+#define ROWBYTES (WIDTH * 3)
+
+#include "pngmembuf.h"
+
+static png_byte image[HEIGHT][ROWBYTES];
+static int warnings;
+
+/* The input with a count of the read calls.  'file' must be first;
+ * buffer_read uses the io_ptr as a buffer.
+ */
+typedef struct
+{
+   buffer        file;
+   unsigned long calls;
+} source;
+
+/* How the sequential reader gets its data */
+#define READ_PLAIN 0  /* png_set_read_fn */
+#define READ_AHEAD 1  /* png_set_read_ahead_fn */
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   fprintf(stderr, "pngidat: %s\n", message);
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+expected_error_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)message;
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)png_ptr;
+   (void)message;
+   ++warnings;
+}
+
+static void PNGCBAPI
+counting_read(png_structp png_ptr, png_bytep data, size_t size)
+{
+   ++((source*)png_get_io_ptr(png_ptr))->calls;
+   buffer_read(png_ptr, data, size);
+}
+
+static size_t PNGCBAPI
+counting_read_ahead(png_structp png_ptr, png_bytep data, size_t size)
+{
+   source *s = (source*)png_get_io_ptr(png_ptr);
+   size_t avail = s->file.size - s->file.read;
+
+   if (size > avail)
+      size = avail;
+
+   ++s->calls;
+   memcpy(data, s->file.data + s->file.read, size);
+   s->file.read += size;
+   return size;
+}
+
+static void
+make_image(void)
+{
+   png_uint_32 x, y;
+   png_uint_32 h = 1;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < ROWBYTES; ++x)
+      {
+         h = h * 1103515245U + 12345U;
+         image[y][x] = (png_byte)(h >> 24);
+      }
+}
+
+/* Count the IDAT chunks of a file */
+static unsigned int
+count_IDAT(const buffer *b)
+{
+   size_t offset = 8;
+   unsigned int count = 0;
+
+   while (offset + 12 <= b->size)
+   {
+      if (memcmp(b->data + offset + 4, "IDAT", 4) == 0)
+         ++count;
+
+      offset += 12 + png_get_uint_32(b->data + offset);
+   }
+
+   return count;
+}
+
+/* Check that every IDAT chunk but the last has 'size' bytes and the last has
+ * at most that many.
+ */
+static int
+check_IDAT(const buffer *b, png_uint_32 size, const char *what)
+{
+   size_t offset = 8;
+   unsigned int count = count_IDAT(b), n = 0;
+
+   while (offset + 12 <= b->size)
+   {
+      png_uint_32 length = png_get_uint_32(b->data + offset);
+
+      if (memcmp(b->data + offset + 4, "IDAT", 4) == 0 &&
+          (++n < count ? length != size : length == 0 || length > size))
+      {
+         fprintf(stderr, "pngidat: %s: IDAT %u of %u has %lu bytes\n", what,
+            n, count, (unsigned long)length);
+         return 1;
+      }
+
+      offset += 12 + length;
+   }
+
+   return 0;
+}
+
+/* Write the image with IDAT chunks of IDAT_size bytes; if 'rejected' is set
+ * each of the invalid sizes 1 to 5 is then tried and must give a warning.
+ * Returns the number of sizes wrongly accepted.
+ */
+static int
+write_png(buffer *b, png_uint_32 IDAT_size, int rejected)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   int errors = 0;
+
+   memset(b, 0, sizeof *b);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngidat: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      fprintf(stderr, "pngidat: failed to write test image\n");
+      exit(1);
+   }
+
+   png_set_write_fn(png_ptr, b, buffer_write, buffer_flush);
+   png_set_IDAT_chunk_size(png_ptr, IDAT_size);
+
+   if (rejected)
+   {
+      png_uint_32 size;
+
+      for (size = 1; size < 6; ++size)
+      {
+         int before = warnings;
+
+         png_set_IDAT_chunk_size(png_ptr, size);
+
+         if (warnings != before + 1)
+         {
+            fprintf(stderr, "pngidat: IDAT size %lu accepted\n",
+               (unsigned long)size);
+            ++errors;
+         }
+      }
+   }
+
+   png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+   png_write_info(png_ptr, info_ptr);
+
+   for (y = 0; y < HEIGHT; ++y)
+      png_write_row(png_ptr, image[y]);
+
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   return errors;
+}
+
+/* Read the file with the sequential reader, comparing the rows with the
+ * image.  Returns the number of read calls or 0 on failure.
+ */
+static unsigned long
+read_png(const buffer *b, int how, int adaptive)
+{
+   static png_byte row[ROWBYTES];
+   source s;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   volatile unsigned long calls = 0;
+
+   s.file = *b;
+   s.file.read = 0;
+   s.calls = 0;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 0;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      int ok = 1;
+
+      png_set_option(png_ptr, PNG_ADAPTIVE_IDAT_READ, adaptive);
+
+      if (how == READ_AHEAD)
+         png_set_read_ahead_fn(png_ptr, &s, counting_read_ahead, 0);
+
+      else
+         png_set_read_fn(png_ptr, &s, counting_read);
+
+      png_read_info(png_ptr, info_ptr);
+
+      for (y = 0; y < HEIGHT; ++y)
+      {
+         png_read_row(png_ptr, row, NULL);
+         ok &= memcmp(row, image[y], ROWBYTES) == 0;
+      }
+
+      png_read_end(png_ptr, info_ptr);
+
+      if (ok)
+         calls = s.calls;
+
+      else
+         fprintf(stderr, "pngidat: pixels differ\n");
+   }
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return calls;
+}
+
+/* Read the file with png_image_begin_read_from_memory */
+static int
+read_memory(const buffer *b)
+{
+   static png_byte pixels[HEIGHT][ROWBYTES];
+   png_image im;
+   int ok;
+
+   memset(&im, 0, sizeof im);
+   im.version = PNG_IMAGE_VERSION;
+
+   if (!png_image_begin_read_from_memory(&im, b->data, b->size))
+   {
+      fprintf(stderr, "pngidat: %s\n", im.message);
+      return 0;
+   }
+
+   im.format = PNG_FORMAT_RGB;
+
+   if (!png_image_finish_read(&im, NULL, pixels, ROWBYTES, NULL))
+   {
+      fprintf(stderr, "pngidat: %s\n", im.message);
+      return 0;
+   }
+
+   ok = memcmp(pixels, image, sizeof pixels) == 0;
+
+   if (!ok)
+      fprintf(stderr, "pngidat: pixels differ\n");
+
+   return ok;
+}
+
+static int
+test_file(const buffer *b, const char *what, int large)
+{
+   int errors = 0;
+   int how, adaptive;
+
+   for (how = READ_PLAIN; how <= READ_AHEAD; ++how)
+   {
+      unsigned long calls[2];
+
+      for (adaptive = 0; adaptive <= 1; ++adaptive)
+      {
+         calls[adaptive] = read_png(b, how, adaptive);
+
+         if (calls[adaptive] == 0)
+         {
+            fprintf(stderr, "pngidat: %s, %s, adaptive %s: read failed\n",
+               what, how == READ_AHEAD ? "read-ahead" : "read_fn",
+               adaptive ? "on" : "off");
+            ++errors;
+         }
+      }
+
+      /* The adaptive read only applies when IDAT data is read through a
+       * buffer; it must then read the large chunk in one call.
+       */
+      if (large && how == READ_PLAIN && calls[1] >= calls[0])
+      {
+         fprintf(stderr, "pngidat: %s: %lu calls with the adaptive read,"
+            " %lu without\n", what, calls[1], calls[0]);
+         ++errors;
+      }
+   }
+
+   if (!read_memory(b))
+   {
+      fprintf(stderr, "pngidat: %s: memory read failed\n", what);
+      ++errors;
+   }
+
+   return errors;
+}
+
+/* The IDAT chunks written for sizes around the compression buffer size */
+static int
+test_IDAT_sizes(void)
+{
+   static const struct
+   {
+      png_uint_32 set;       /* the png_set_IDAT_chunk_size argument */
+      png_uint_32 expect;    /* the size of all but the last chunk */
+   } sizes[] =
+   {
+      { 0, PNG_ZBUF_SIZE },                     /* the default */
+      { 6, 6 },                                 /* the smallest */
+      { 1000, 1000 },
+      { 2*PNG_ZBUF_SIZE + 100, 2*PNG_ZBUF_SIZE } /* rounded down */
+   };
+   unsigned int i;
+   int errors = 0;
+
+   for (i = 0; i < (sizeof sizes)/(sizeof sizes[0]); ++i)
+   {
+      buffer b;
+      char what[32];
+
+      sprintf(what, "IDAT size %lu", (unsigned long)sizes[i].set);
+      write_png(&b, sizes[i].set, 0);
+      errors += check_IDAT(&b, sizes[i].expect, what);
+
+      if (count_IDAT(&b) < 2)
+      {
+         fprintf(stderr, "pngidat: %s: only one IDAT\n", what);
+         ++errors;
+      }
+
+      free(b.data);
+   }
+
+   return errors;
+}
+
+/* png_set_IDAT_chunk_size is an application error on a read struct */
+static int
+test_read_struct(void)
+{
+   png_structp png_ptr;
+   volatile int errors = 1;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+      expected_error_fn, warning_fn);
+
+   if (png_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+#     ifdef PNG_BENIGN_ERRORS_SUPPORTED
+      png_set_benign_errors(png_ptr, 0/*error*/);
+#     endif
+      png_set_IDAT_chunk_size(png_ptr, 16);
+      fprintf(stderr, "pngidat: IDAT size accepted on read\n");
+   }
+
+   else
+      errors = 0;
+
+   png_destroy_read_struct(&png_ptr, NULL, NULL);
+   return errors;
+}
+
+#ifdef PNG_SIMPLIFIED_WRITE_SUPPORTED
+/* png_image_write_to_memory writes all the image data in one IDAT chunk */
+static int
+test_write_to_memory(void)
+{
+   png_image im;
+   buffer b;
+   png_alloc_size_t size = 0;
+   int errors = 0;
+
+   memset(&im, 0, sizeof im);
+   im.version = PNG_IMAGE_VERSION;
+   im.width = WIDTH;
+   im.height = HEIGHT;
+   im.format = PNG_FORMAT_RGB;
+
+   if (!png_image_write_to_memory(&im, NULL, &size, 0, image, ROWBYTES, NULL))
+   {
+      fprintf(stderr, "pngidat: %s\n", im.message);
+      return 1;
+   }
+
+   memset(&b, 0, sizeof b);
+   b.data = (png_bytep)malloc(size);
+   b.size = b.allocated = size;
+
+   if (b.data == NULL ||
+       !png_image_write_to_memory(&im, b.data, &size, 0, image, ROWBYTES,
+          NULL))
+   {
+      fprintf(stderr, "pngidat: %s\n", im.message);
+      free(b.data);
+      return 1;
+   }
+
+   if (count_IDAT(&b) != 1)
+   {
+      fprintf(stderr, "pngidat: png_image_write_to_memory wrote %u IDATs\n",
+         count_IDAT(&b));
+      ++errors;
+   }
+
+   errors += test_file(&b, "png_image_write_to_memory", 1);
+   free(b.data);
+   return errors;
+}
+#endif
+
+int
+main(void)
+{
+   buffer large, tiny;
+   int errors = 0;
+
+   make_image();
+   errors += write_png(&large, PNG_UINT_31_MAX, 0);
+   errors += write_png(&tiny, 16, 1/*rejected sizes*/);
+
+   if (count_IDAT(&large) != 1 || count_IDAT(&tiny) < 100)
+   {
+      fprintf(stderr, "pngidat: %u and %u IDAT chunks written\n",
+         count_IDAT(&large), count_IDAT(&tiny));
+      ++errors;
+   }
+
+   errors += check_IDAT(&tiny, 16, "tiny IDATs");
+   errors += test_IDAT_sizes();
+   errors += test_read_struct();
+#  ifdef PNG_SIMPLIFIED_WRITE_SUPPORTED
+   errors += test_write_to_memory();
+#  endif
+
+   errors += test_file(&large, "one IDAT", 1);
+   errors += test_file(&tiny, "tiny IDATs", 0);
+
+   free(large.data);
+   free(tiny.data);
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pngidat: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(SEQUENTIAL_READ && WRITE && SET_OPTION && SIMPLIFIED_READ) */
+int
+main(void)
+{
+   fprintf(stderr, " test ignored: no sequential read or set option support\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
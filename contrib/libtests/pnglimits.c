@@ -0,0 +1,594 @@
+/* pnglimits.c - test the read side resource limits
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  Each
+ *   test writes a small PNG to memory, chosen so that it trips exactly one
+ *   limit, then reads it back with the sequential and the progressive reader,
+ *   first without the limit, when it must succeed, and then with the limit,
+ *   when it must fail with the expected error message.
+ *
+ *   If libpng was built with MEMORY_BUDGET the ways the reader gives memory
+ *   up under a budget are also tested: these reads must succeed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_SET_USER_LIMITS_SUPPORTED) &&\
+   defined(PNG_SEQUENTIAL_READ_SUPPORTED) &&\
+   defined(PNG_PROGRESSIVE_READ_SUPPORTED) &&\
+   defined(PNG_WRITE_SUPPORTED)
+
+#include "pngmembuf.h"
+
+/* What the reader should do */
+typedef struct
+{
+   const char *name;
+   const buffer *file;
+   int         limited;  /* apply the limit */
+   void      (*set_limit)(png_structp);
+   const char *expect;   /* expected error message, NULL for success */
+   char        message[256];
+} test;
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   test *t = (test*)png_get_error_ptr(png_ptr);
+
+   strncpy(t->message, message, (sizeof t->message) - 1);
+   t->message[(sizeof t->message) - 1] = 0;
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)png_ptr;
+   (void)message;
+}
+
+/* Write a gray image whose samples are given by 'fill' with optional text.
+ * 'one_IDAT' writes all the image data in a single chunk.
+ */
+static void
+make_png(buffer *b, png_uint_32 width, png_uint_32 height, int bit_depth,
+   unsigned int (*fill)(png_uint_32 x, png_uint_32 y), png_textp text,
+   int num_text, int one_IDAT)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_bytep row;
+   png_uint_32 x, y;
+
+   memset(b, 0, sizeof *b);
+   row = (png_bytep)malloc(width * (bit_depth / 8));
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (row == NULL || info_ptr == NULL)
+   {
+      fprintf(stderr, "pnglimits: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      fprintf(stderr, "pnglimits: failed to write test image\n");
+      exit(1);
+   }
+
+   png_set_write_fn(png_ptr, b, buffer_write, buffer_flush);
+   png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth,
+      PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
+      PNG_FILTER_TYPE_BASE);
+
+   if (num_text > 0)
+      png_set_text(png_ptr, info_ptr, text, num_text);
+
+   if (one_IDAT)
+      png_set_IDAT_chunk_size(png_ptr, PNG_UINT_31_MAX);
+
+   png_write_info(png_ptr, info_ptr);
+
+   for (y = 0; y < height; ++y)
+   {
+      for (x = 0; x < width; ++x)
+      {
+         unsigned int v = fill(x, y);
+
+         if (bit_depth == 16)
+         {
+            row[2*x] = (png_byte)(v >> 8);
+            row[2*x+1] = (png_byte)v;
+         }
+
+         else
+            row[x] = (png_byte)v;
+      }
+
+      png_write_row(png_ptr, row);
+   }
+
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   free(row);
+}
+
+static unsigned int
+fill_zero(png_uint_32 x, png_uint_32 y)
+{
+   (void)x;
+   (void)y;
+   return 0;
+}
+
+static unsigned int
+fill_pattern(png_uint_32 x, png_uint_32 y)
+{
+   return 0xff & ((x * 7 + y * 13) ^ (x * y));
+}
+
+static void
+set_up(png_structp png_ptr, test *t)
+{
+   png_set_error_fn(png_ptr, t, error_fn, warning_fn);
+
+   if (t->limited)
+      t->set_limit(png_ptr);
+}
+
+static void
+read_sequential(test *t)
+{
+   buffer file = *t->file;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_bytep row = NULL;
+
+   file.read = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, t, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_uint_32 y;
+
+      set_up(png_ptr, t);
+      png_set_read_fn(png_ptr, &file, buffer_read);
+      png_read_info(png_ptr, info_ptr);
+      png_start_read_image(png_ptr);
+      row = (png_bytep)png_malloc(png_ptr,
+         png_get_rowbytes(png_ptr, info_ptr));
+
+      for (y = 0; y < png_get_image_height(png_ptr, info_ptr); ++y)
+         png_read_row(png_ptr, row, NULL);
+
+      png_read_end(png_ptr, info_ptr);
+   }
+
+   png_free(png_ptr, row);
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+static void PNGCBAPI
+progressive_info(png_structp png_ptr, png_infop info_ptr)
+{
+   (void)info_ptr;
+   png_start_read_image(png_ptr);
+}
+
+static void
+read_progressive(test *t)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, t, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      size_t i;
+
+      set_up(png_ptr, t);
+      png_set_progressive_read_fn(png_ptr, NULL, progressive_info, NULL,
+         NULL);
+
+      /* Small pieces so that the limits are checked part way through */
+      for (i = 0; i < t->file->size; i += 97)
+      {
+         size_t size = t->file->size - i;
+
+         png_process_data(png_ptr, info_ptr, t->file->data + i,
+            size < 97 ? size : 97);
+      }
+   }
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+static int
+check(test *t, const char *reader)
+{
+   const char *expect = t->limited ? t->expect : NULL;
+
+   if (expect == NULL ? t->message[0] == 0 :
+       strstr(t->message, expect) != NULL)
+      return 0;
+
+   fprintf(stderr, "pnglimits: %s, %s reader, %s: got \"%s\", expected %s\n",
+      t->name, reader, t->limited ? "limited" : "unlimited", t->message,
+      expect == NULL ? "success" : expect);
+   return 1;
+}
+
+static int
+run(const char *name, const buffer *file, void (*set_limit)(png_structp),
+   const char *expect)
+{
+   test t;
+   int errors = 0;
+
+   memset(&t, 0, sizeof t);
+   t.name = name;
+   t.file = file;
+   t.set_limit = set_limit;
+   t.expect = expect;
+
+   for (t.limited = 0; t.limited <= 1; ++t.limited)
+   {
+      t.message[0] = 0;
+      read_sequential(&t);
+      errors += check(&t, "sequential");
+
+      t.message[0] = 0;
+      read_progressive(&t);
+      errors += check(&t, "progressive");
+   }
+
+   return errors;
+}
+
+static void
+limit_ratio(png_structp png_ptr)
+{
+   png_set_inflate_ratio_max(png_ptr, 100);
+}
+
+static void
+limit_IDAT_size(png_structp png_ptr)
+{
+   png_set_inflate_size_max(png_ptr, (png_const_bytep)"IDAT", 1000);
+}
+
+static void
+limit_zTXt_size(png_structp png_ptr)
+{
+   png_set_inflate_size_max(png_ptr, (png_const_bytep)"zTXt", 1000);
+}
+
+static void
+limit_chunk_count(png_structp png_ptr)
+{
+   png_set_chunk_count_max(png_ptr, 8);
+}
+
+static int PNGCBAPI
+deadline_passed(png_structp png_ptr)
+{
+   (void)png_ptr;
+   return 1;
+}
+
+static void
+limit_deadline(png_structp png_ptr)
+{
+   png_set_read_deadline_fn(png_ptr, deadline_passed, 16);
+}
+
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+/* The result of reading a file under a memory budget */
+typedef struct
+{
+   test             t;          /* for the error message */
+   png_bytep        image;      /* the decoded rows */
+   size_t           image_size;
+   int              num_text;   /* text chunks kept */
+   png_alloc_size_t peak;       /* png_get_memory_usage */
+} budget_read;
+
+#define BUDGET_GAMMA    1 /* apply a gamma transform */
+#define BUDGET_ADAPTIVE 2 /* PNG_ADAPTIVE_IDAT_READ */
+
+static void
+read_budget(budget_read *r, const buffer *b, png_alloc_size_t budget,
+   int flags)
+{
+   buffer file = *b;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_bytepp rows = NULL;
+
+   memset(r, 0, sizeof *r);
+   file.read = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, &r->t, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_uint_32 y, height;
+      size_t rowbytes;
+      png_textp text;
+
+      png_set_memory_budget(png_ptr, budget);
+      png_set_read_fn(png_ptr, &file, buffer_read);
+
+#     ifdef PNG_SET_OPTION_SUPPORTED
+      if ((flags & BUDGET_ADAPTIVE) != 0)
+         png_set_option(png_ptr, PNG_ADAPTIVE_IDAT_READ, PNG_OPTION_ON);
+#     endif
+
+      png_read_info(png_ptr, info_ptr);
+
+      if ((flags & BUDGET_GAMMA) != 0)
+         png_set_gamma(png_ptr, 2.2, 1/1.5);
+
+      png_read_update_info(png_ptr, info_ptr);
+      height = png_get_image_height(png_ptr, info_ptr);
+      rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+
+      /* The application's memory is not part of the budget */
+      r->image_size = rowbytes * height;
+      r->image = (png_bytep)malloc(r->image_size);
+      rows = (png_bytepp)malloc(height * (sizeof *rows));
+
+      if (r->image == NULL || rows == NULL)
+         png_error(png_ptr, "test out of memory");
+
+      for (y = 0; y < height; ++y)
+         rows[y] = r->image + y * rowbytes;
+
+      png_read_image(png_ptr, rows);
+      png_read_end(png_ptr, info_ptr);
+      r->num_text = png_get_text(png_ptr, info_ptr, &text, NULL);
+      png_get_memory_usage(png_ptr, NULL, &r->peak);
+   }
+
+   free(rows);
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+}
+
+/* Read 'file' without a budget and then with one, between the peak usage of
+ * 'small' (a read that does not need the memory that is given up) and that
+ * of the unlimited read.  The budgeted read must succeed within the budget
+ * with the same number of text chunks as 'small'.  If 'exact' is set the
+ * pixels must also be unchanged, otherwise they must differ, but by at most
+ * 1/64 of the range.
+ */
+static int
+run_budget(const char *name, const buffer *file, int flags,
+   const buffer *small_file, int small_flags, int exact)
+{
+   budget_read full, small, limited;
+   png_alloc_size_t budget;
+   int errors = 0;
+
+   read_budget(&full, file, 0, flags);
+   read_budget(&small, small_file, 0, small_flags);
+
+   if (full.t.message[0] != 0 || small.t.message[0] != 0)
+   {
+      fprintf(stderr, "pnglimits: %s: unlimited read failed: %s%s\n", name,
+         full.t.message, small.t.message);
+      ++errors;
+   }
+
+   else if (small.peak >= full.peak)
+   {
+      fprintf(stderr, "pnglimits: %s: peak %lu not above %lu\n", name,
+         (unsigned long)full.peak, (unsigned long)small.peak);
+      ++errors;
+   }
+
+   else
+   {
+      budget = small.peak + (full.peak - small.peak) / 4;
+      read_budget(&limited, file, budget, flags);
+
+      if (limited.t.message[0] != 0)
+      {
+         fprintf(stderr, "pnglimits: %s: budget %lu: %s\n", name,
+            (unsigned long)budget, limited.t.message);
+         ++errors;
+      }
+
+      else
+      {
+         size_t i, max_diff = 0;
+
+         if (limited.peak > budget)
+         {
+            fprintf(stderr, "pnglimits: %s: peak %lu over budget %lu\n", name,
+               (unsigned long)limited.peak, (unsigned long)budget);
+            ++errors;
+         }
+
+         if (limited.num_text != small.num_text)
+         {
+            fprintf(stderr, "pnglimits: %s: %d text chunks, expected %d\n",
+               name, limited.num_text, small.num_text);
+            ++errors;
+         }
+
+         /* 16-bit samples, compared as such */
+         for (i = 0; i + 1 < full.image_size; i += 2)
+         {
+            int a = (full.image[i] << 8) + full.image[i+1];
+            int b = (limited.image[i] << 8) + limited.image[i+1];
+            size_t diff = (size_t)(a > b ? a - b : b - a);
+
+            if (diff > max_diff)
+               max_diff = diff;
+         }
+
+         if (exact ? max_diff != 0 : max_diff == 0 || max_diff > 65535/64)
+         {
+            fprintf(stderr, "pnglimits: %s: samples differ by %lu\n", name,
+               (unsigned long)max_diff);
+            ++errors;
+         }
+      }
+
+      free(limited.image);
+   }
+
+   free(full.image);
+   free(small.image);
+   return errors;
+}
+
+static unsigned int
+fill_ramp(png_uint_32 x, png_uint_32 y)
+{
+   return (x * 256 + y) & 0xffff;
+}
+
+static unsigned int
+fill_noise(png_uint_32 x, png_uint_32 y)
+{
+   png_uint_32 h = (x * 2654435761U) ^ (y * 40503U + 0x9e3779b9U);
+
+   h ^= h >> 15;
+   h *= 2246822519U;
+   return (h >> 13) & 0xff;
+}
+#endif /* MEMORY_BUDGET */
+
+int
+main(void)
+{
+   buffer zeros, pattern, ztxt, texts;
+   png_text text[10];
+   char long_text[10001];
+   int i, errors = 0;
+
+   /* 256K of zero samples compress more than 100:1 */
+   make_png(&zeros, 512, 512, 8, fill_zero, NULL, 0, 0);
+   make_png(&pattern, 64, 64, 8, fill_pattern, NULL, 0, 0);
+
+   memset(long_text, 'a', (sizeof long_text) - 1);
+   long_text[(sizeof long_text) - 1] = 0;
+   memset(text, 0, sizeof text);
+   text[0].compression = PNG_TEXT_COMPRESSION_zTXt;
+   text[0].key = (png_charp)"Comment";
+   text[0].text = long_text;
+   make_png(&ztxt, 8, 8, 8, fill_pattern, text, 1, 0);
+
+   /* IHDR, ten tEXt, IDAT and IEND */
+   for (i = 0; i < 10; ++i)
+   {
+      text[i].compression = PNG_TEXT_COMPRESSION_NONE;
+      text[i].key = (png_charp)"Comment";
+      text[i].text = (png_charp)"text";
+   }
+   make_png(&texts, 8, 8, 8, fill_pattern, text, 10, 0);
+
+   errors += run("ratio", &zeros, limit_ratio,
+      "compression ratio limit exceeded");
+   errors += run("IDAT size", &pattern, limit_IDAT_size,
+      "decompressed size limit exceeded");
+   errors += run("zTXt size", &ztxt, limit_zTXt_size,
+      "decompressed size limit exceeded");
+   errors += run("chunk count", &texts, limit_chunk_count, "too many chunks");
+   errors += run("deadline", &pattern, limit_deadline,
+      "read deadline exceeded");
+
+#  ifdef PNG_MEMORY_BUDGET_SUPPORTED
+   {
+      buffer plain, big_text, ramp, noise;
+      png_text comment;
+      char *comment_text = (char*)malloc(100001);
+
+      if (comment_text == NULL)
+         return 1;
+
+      memset(comment_text, 'a', 100000);
+      comment_text[100000] = 0;
+      memset(&comment, 0, sizeof comment);
+      comment.compression = PNG_TEXT_COMPRESSION_NONE;
+      comment.key = (png_charp)"Comment";
+      comment.text = comment_text;
+
+      make_png(&plain, 64, 64, 8, fill_pattern, NULL, 0, 0);
+      make_png(&big_text, 64, 64, 8, fill_pattern, &comment, 1, 0);
+      make_png(&ramp, 256, 64, 16, fill_ramp, NULL, 0, 0);
+      make_png(&noise, 512, 512, 8, fill_noise, NULL, 0, 1);
+      free(comment_text);
+
+      /* An ancillary chunk that does not fit is skipped */
+      errors += run_budget("budget text", &big_text, 0, &plain, 0, 1);
+      /* 16-bit gamma tables are built with less precision */
+      errors += run_budget("budget gamma", &ramp, BUDGET_GAMMA, &ramp, 0, 0);
+#     ifdef PNG_SET_OPTION_SUPPORTED
+      /* A single large IDAT chunk is read in smaller pieces */
+      errors += run_budget("budget IDAT", &noise, BUDGET_ADAPTIVE, &noise, 0,
+         1);
+#     endif
+
+      free(plain.data);
+      free(big_text.data);
+      free(ramp.data);
+      free(noise.data);
+   }
+#  endif
+
+   free(zeros.data);
+   free(pattern.data);
+   free(ztxt.data);
+   free(texts.data);
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pnglimits: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(SET_USER_LIMITS && SEQUENTIAL_READ && PROGRESSIVE_READ && WRITE) */
+int
+main(void)
+{
+   fprintf(stderr, " test ignored: no support to set read limits\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
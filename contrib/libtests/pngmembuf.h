@@ -0,0 +1,58 @@
+/* contrib/libtests/pngmembuf.h
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * An in-memory PNG file with libpng read and write callbacks, shared by the
+ * test and benchmark programs that write a PNG and then read it back.
+ * Include this after png.h, <stdlib.h> and <string.h>.  The write callback
+ * grows the buffer as required; the read callback reads from 'read' onward,
+ * so set 'read' to 0 before each read.
+ */
+typedef struct
+{
+   png_bytep   data;
+   size_t      size;
+   size_t      allocated;
+   size_t      read;   /* read position */
+} buffer;
+
+static void PNGCBAPI
+buffer_write(png_structp png_ptr, png_bytep data, size_t size)
+{
+   buffer *b = (buffer*)png_get_io_ptr(png_ptr);
+
+   if (b->size + size > b->allocated)
+   {
+      size_t allocated = 2 * (b->size + size);
+      png_bytep new_data = (png_bytep)realloc(b->data, allocated);
+
+      if (new_data == NULL)
+         png_error(png_ptr, "out of memory");
+
+      b->data = new_data;
+      b->allocated = allocated;
+   }
+
+   memcpy(b->data + b->size, data, size);
+   b->size += size;
+}
+
+static void PNGCBAPI
+buffer_flush(png_structp png_ptr)
+{
+   (void)png_ptr;
+}
+
+static void PNGCBAPI
+buffer_read(png_structp png_ptr, png_bytep data, size_t size)
+{
+   buffer *b = (buffer*)png_get_io_ptr(png_ptr);
+
+   if (size > b->size - b->read)
+      png_error(png_ptr, "read beyond end of file");
+
+   memcpy(data, b->data + b->read, size);
+   b->read += size;
+}
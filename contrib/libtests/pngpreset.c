@@ -0,0 +1,473 @@
+/* pngpreset.c - test png_set_compression_preset
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  It
+ *   writes synthetic, photograph-like, palette, interlaced and byte swapped
+ *   16-bit images with each compression preset through png_write_row,
+ *   png_write_rows and png_write_image and checks that:
+ *
+ *   1) the file is byte for byte the same as one written with the filters and
+ *      zlib settings the preset stands for, set individually; for
+ *      PNG_COMPRESSION_AUTO this checks the class the image is given,
+ *   2) the pixels read back are those written, and
+ *   3) an invalid preset is an application error.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+#include <zlib.h> /* for Z_RLE */
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED) &&\
+   defined(PNG_SEQUENTIAL_READ_SUPPORTED) &&\
+   defined(PNG_WRITE_FILTER_SUPPORTED) &&\
+   defined(PNG_WRITE_INTERLACING_SUPPORTED) &&\
+   defined(PNG_READ_INTERLACING_SUPPORTED) &&\
+   defined(PNG_WRITE_SWAP_SUPPORTED) && defined(PNG_READ_SWAP_SUPPORTED) &&\
+   defined(PNG_BENIGN_ERRORS_SUPPORTED)
+
+#define WIDTH  64
+#define HEIGHT 48
+#define MAX_ROWBYTES (WIDTH * 3)
+
+#include "pngmembuf.h"
+
+/* What PNG_COMPRESSION_AUTO should make of an image */
+#define SYNTHETIC 0 /* no filtering */
+#define PHOTO     1 /* all filters and Z_RLE */
+
+/* How the rows are passed to libpng */
+#define WRITE_ROW   0
+#define WRITE_ROWS  1
+#define WRITE_IMAGE 2
+
+typedef struct
+{
+   const char *name;
+   int         color_type;
+   int         bit_depth;
+   int         interlace;
+   int         swap;       /* rows are little-endian, png_set_swap */
+   int         content;    /* SYNTHETIC or PHOTO */
+   size_t      rowbytes;
+   png_byte    pixels[HEIGHT][MAX_ROWBYTES];
+   png_bytep   rows[HEIGHT];
+} test_image;
+
+static test_image images[5];
+
+static const char *preset_name[] =
+{
+   "default", "fastest", "balanced", "smallest", "auto"
+};
+
+static const char *write_name[] = { "png_write_row", "png_write_rows",
+   "png_write_image" };
+
+static png_uint_32 seed = 1;
+
+static unsigned int
+random_bits(int bits)
+{
+   seed = seed * 1103515245U + 12345U;
+   return (seed >> 16) & ((1U << bits) - 1);
+}
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   fprintf(stderr, "pngpreset: %s\n", message);
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+expected_error_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)message;
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)png_ptr;
+   (void)message;
+}
+
+static void
+init_image(test_image *im, const char *name, int color_type, int bit_depth,
+   int interlace, int content)
+{
+   int channels = color_type == PNG_COLOR_TYPE_RGB ? 3 : 1;
+   png_uint_32 y;
+
+   im->name = name;
+   im->color_type = color_type;
+   im->bit_depth = bit_depth;
+   im->interlace = interlace;
+   im->swap = 0;
+   im->content = content;
+   im->rowbytes = WIDTH * channels * (bit_depth >> 3);
+
+   for (y = 0; y < HEIGHT; ++y)
+      im->rows[y] = im->pixels[y];
+}
+
+/* Flat blocks of colours that differ by a lot */
+static void
+make_synthetic(test_image *im)
+{
+   png_uint_32 x, y;
+   size_t channels = im->rowbytes / WIDTH;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < im->rowbytes; ++x)
+      {
+         unsigned int block = (unsigned int)((x / channels) / 16 + y / 12 * 4);
+
+         im->pixels[y][x] = (png_byte)(((block * 5 + x % channels) & 3) * 80);
+      }
+}
+
+/* A gradient with noise: most pixels change a little */
+static void
+make_photo(test_image *im)
+{
+   png_uint_32 x, y;
+   size_t channels = im->rowbytes / WIDTH;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < im->rowbytes; ++x)
+         im->pixels[y][x] = (png_byte)((x / channels) * 2 + y + x % channels * 40
+            + random_bits(3));
+}
+
+/* 16-bit gray stored little-endian: the high bytes are a photograph and the
+ * low bytes are noise, so the image is only a photograph if the right byte is
+ * examined.
+ */
+static void
+make_swapped(test_image *im)
+{
+   png_uint_32 x, y;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < WIDTH; ++x)
+      {
+         im->pixels[y][2*x] = (png_byte)random_bits(8);
+         im->pixels[y][2*x+1] = (png_byte)(x * 2 + y + random_bits(3));
+      }
+}
+
+static void
+make_images(void)
+{
+   init_image(&images[0], "synthetic", PNG_COLOR_TYPE_RGB, 8,
+      PNG_INTERLACE_NONE, SYNTHETIC);
+   make_synthetic(&images[0]);
+
+   init_image(&images[1], "photo", PNG_COLOR_TYPE_RGB, 8,
+      PNG_INTERLACE_NONE, PHOTO);
+   make_photo(&images[1]);
+
+   /* The classifier sees photograph-like indices but a palette image is
+    * never filtered.
+    */
+   init_image(&images[2], "palette", PNG_COLOR_TYPE_PALETTE, 8,
+      PNG_INTERLACE_NONE, PHOTO);
+   make_photo(&images[2]);
+
+   init_image(&images[3], "interlaced", PNG_COLOR_TYPE_RGB, 8,
+      PNG_INTERLACE_ADAM7, PHOTO);
+   make_photo(&images[3]);
+
+   init_image(&images[4], "swapped 16-bit", PNG_COLOR_TYPE_GRAY, 16,
+      PNG_INTERLACE_NONE, PHOTO);
+   images[4].swap = 1;
+   make_swapped(&images[4]);
+}
+
+/* Set the filters and zlib parameters that 'preset' stands for */
+static void
+set_reference(png_structp png_ptr, const test_image *im, int preset)
+{
+   int filters = PNG_ALL_FILTERS;
+
+   if (preset == PNG_COMPRESSION_DEFAULT)
+      return;
+
+   png_set_compression_level(png_ptr, 6);
+   png_set_compression_mem_level(png_ptr, 8);
+   png_set_compression_window_bits(png_ptr, 15);
+
+   switch (preset)
+   {
+      case PNG_COMPRESSION_FASTEST:
+         png_set_compression_level(png_ptr, 1);
+         filters = PNG_FILTER_SUB;
+         break;
+
+      case PNG_COMPRESSION_SMALLEST:
+         png_set_compression_level(png_ptr, 9);
+         png_set_compression_mem_level(png_ptr, 9);
+         break;
+
+      case PNG_COMPRESSION_AUTO:
+         if (im->content == SYNTHETIC)
+            filters = PNG_FILTER_NONE;
+
+         else
+            png_set_compression_strategy(png_ptr, Z_RLE);
+         break;
+
+      default:
+         break;
+   }
+
+   if (im->color_type == PNG_COLOR_TYPE_PALETTE)
+      filters = PNG_FILTER_NONE;
+
+   png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
+}
+
+/* Write the image with the preset or, if 'reference' is set, with the
+ * equivalent individual settings.
+ */
+static void
+write_png(buffer *b, test_image *im, int preset, int reference, int how)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+
+   memset(b, 0, sizeof *b);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngpreset: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      fprintf(stderr, "pngpreset: %s: failed to write image\n", im->name);
+      exit(1);
+   }
+
+   png_set_write_fn(png_ptr, b, buffer_write, buffer_flush);
+
+   if (reference)
+      set_reference(png_ptr, im, preset);
+
+   else
+      png_set_compression_preset(png_ptr, preset);
+
+   png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, im->bit_depth,
+      im->color_type, im->interlace, PNG_COMPRESSION_TYPE_BASE,
+      PNG_FILTER_TYPE_BASE);
+
+   if (im->color_type == PNG_COLOR_TYPE_PALETTE)
+   {
+      png_color palette[256];
+      int i;
+
+      for (i = 0; i < 256; ++i)
+         palette[i].red = palette[i].green = palette[i].blue = (png_byte)i;
+
+      png_set_PLTE(png_ptr, info_ptr, palette, 256);
+   }
+
+   png_write_info(png_ptr, info_ptr);
+
+   if (im->swap)
+      png_set_swap(png_ptr);
+
+   if (how == WRITE_IMAGE)
+      png_write_image(png_ptr, im->rows);
+
+   else
+   {
+      int pass, num_passes = png_set_interlace_handling(png_ptr);
+
+      for (pass = 0; pass < num_passes; ++pass)
+      {
+         if (how == WRITE_ROWS)
+            png_write_rows(png_ptr, im->rows, HEIGHT);
+
+         else
+         {
+            png_uint_32 y;
+
+            for (y = 0; y < HEIGHT; ++y)
+               png_write_row(png_ptr, im->rows[y]);
+         }
+      }
+   }
+
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+}
+
+static int
+read_png(buffer *b, const test_image *im)
+{
+   static png_byte pixels[HEIGHT][MAX_ROWBYTES];
+   png_bytep rows[HEIGHT];
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   volatile int ok = 0;
+
+   for (y = 0; y < HEIGHT; ++y)
+      rows[y] = pixels[y];
+
+   b->read = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 0;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_set_read_fn(png_ptr, b, buffer_read);
+      png_read_info(png_ptr, info_ptr);
+
+      if (im->swap)
+         png_set_swap(png_ptr);
+
+      (void)png_set_interlace_handling(png_ptr);
+      png_read_update_info(png_ptr, info_ptr);
+      png_read_image(png_ptr, rows);
+      png_read_end(png_ptr, info_ptr);
+
+      ok = 1;
+
+      for (y = 0; y < HEIGHT; ++y)
+         ok &= memcmp(pixels[y], im->pixels[y], im->rowbytes) == 0;
+   }
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return ok;
+}
+
+static int
+test_image_preset(test_image *im, int preset)
+{
+   buffer ref;
+   int how, errors = 0;
+
+   write_png(&ref, im, preset, 1/*reference*/, WRITE_ROW);
+
+   for (how = WRITE_ROW; how <= WRITE_IMAGE; ++how)
+   {
+      buffer b;
+
+      write_png(&b, im, preset, 0, how);
+
+      if (b.size != ref.size || memcmp(b.data, ref.data, b.size) != 0)
+      {
+         fprintf(stderr, "pngpreset: %s, %s, %s: not the expected settings\n",
+            im->name, preset_name[preset], write_name[how]);
+         ++errors;
+      }
+
+      if (!read_png(&b, im))
+      {
+         fprintf(stderr, "pngpreset: %s, %s, %s: pixels differ\n", im->name,
+            preset_name[preset], write_name[how]);
+         ++errors;
+      }
+
+      free(b.data);
+   }
+
+   free(ref.data);
+   return errors;
+}
+
+/* An unknown preset is an application error */
+static int
+test_invalid_preset(void)
+{
+   png_structp png_ptr;
+   volatile int errors = 1;
+
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
+      expected_error_fn, warning_fn);
+
+   if (png_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_set_benign_errors(png_ptr, 0/*error*/);
+      png_set_compression_preset(png_ptr, 99);
+      fprintf(stderr, "pngpreset: preset 99 accepted\n");
+   }
+
+   else
+      errors = 0;
+
+   png_destroy_write_struct(&png_ptr, NULL);
+   return errors;
+}
+
+int
+main(void)
+{
+   unsigned int i;
+   int preset, errors = 0;
+
+   make_images();
+
+   for (i = 0; i < (sizeof images)/(sizeof images[0]); ++i)
+      for (preset = PNG_COMPRESSION_DEFAULT; preset <= PNG_COMPRESSION_AUTO;
+           ++preset)
+         errors += test_image_preset(&images[i], preset);
+
+   errors += test_invalid_preset();
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pngpreset: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(WRITE_CUSTOMIZE_COMPRESSION && SEQUENTIAL_READ && ...) */
+int
+main(void)
+{
+   fprintf(stderr, " test ignored: no compression customization support\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
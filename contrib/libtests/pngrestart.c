@@ -0,0 +1,587 @@
+/* pngrestart.c - test the restart points written by PNG_FLUSH_RESTART
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng and zlib.
+ *   It writes an RGB image to memory with the PNG_FLUSH_RESTART option and a
+ *   flush every few rows, then checks that:
+ *
+ *   1) the image reads back correctly,
+ *   2) the sequential and progressive readers both return the restart points
+ *      from the reST chunk through png_get_restart_points, and
+ *   3) each strip between two restart points can be inflated and unfiltered
+ *      on its own, starting at the recorded offset in the IDAT data, which is
+ *      what a parallel decoder does, and
+ *   4) the points are not returned if an offset is past the end of the IDAT
+ *      data, or if the application reads unknown chunks itself.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+#include <zlib.h>
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_WRITE_reST_SUPPORTED) && defined(PNG_READ_reST_SUPPORTED) &&\
+   defined(PNG_SEQUENTIAL_READ_SUPPORTED) &&\
+   defined(PNG_PROGRESSIVE_READ_SUPPORTED)
+
+#define WIDTH  61
+#define HEIGHT 203
+#define STRIP  16
+#define BPP    3
+#define ROWBYTES (WIDTH * BPP)
+
+#include "pngmembuf.h"
+
+static png_byte image[HEIGHT][ROWBYTES];
+
+/* Each row is the same noise plus a slow change down the image, so Up is by far
+ * the best filter and the writer would use it at the start of every strip if
+ * the restart points did not prevent it.
+ */
+static void
+make_image(void)
+{
+   png_uint_32 seed = 1;
+   int x, y;
+
+   for (x = 0; x < ROWBYTES; x++)
+   {
+      seed = seed * 1103515245U + 12345U;
+
+      for (y = 0; y < HEIGHT; y++)
+         image[y][x] = (png_byte)((seed >> 24) + y / 4);
+   }
+}
+
+static int
+make_png(buffer *b)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   int y;
+
+   memset(b, 0, sizeof *b);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngrestart: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      return 1;
+   }
+
+   png_set_write_fn(png_ptr, b, buffer_write, buffer_flush);
+   png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+       PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+#ifdef PNG_WRITE_FILTER_SUPPORTED
+   png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+#endif
+   /* Small IDAT chunks so that the strips cross chunk boundaries. */
+   png_set_compression_buffer_size(png_ptr, 256);
+   png_set_option(png_ptr, PNG_FLUSH_RESTART, 1);
+   png_set_flush(png_ptr, STRIP);
+   png_write_info(png_ptr, info_ptr);
+
+   for (y = 0; y < HEIGHT; y++)
+      png_write_row(png_ptr, image[y]);
+
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   return 0;
+}
+
+/* Check the restart points against the flushes made by make_png: one at each
+ * multiple of STRIP rows.
+ */
+static int
+check_points(const char *reader, png_uint_32 num, png_const_uint_32p points)
+{
+   png_uint_32 i, expect = (HEIGHT - 1) / STRIP;
+
+   if (num != expect)
+   {
+      fprintf(stderr, "pngrestart: %s: %lu restart points, expected %lu\n",
+          reader, (unsigned long)num, (unsigned long)expect);
+      return 1;
+   }
+
+   for (i = 0; i < num; i++)
+      if (points[2*i] != (i+1) * STRIP)
+      {
+         fprintf(stderr, "pngrestart: %s: restart point %lu at row %lu\n",
+             reader, (unsigned long)i, (unsigned long)points[2*i]);
+         return 1;
+      }
+
+   return 0;
+}
+
+static int
+read_sequential(buffer *b)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_bytep row;
+   png_const_uint_32p points = NULL;
+   png_uint_32 num;
+   int y, result;
+
+   b->read = 0;
+   row = (png_bytep)malloc(ROWBYTES);
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (row == NULL || info_ptr == NULL)
+   {
+      fprintf(stderr, "pngrestart: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      free(row);
+      return 1;
+   }
+
+   png_set_read_fn(png_ptr, b, buffer_read);
+   png_read_info(png_ptr, info_ptr);
+
+   for (y = 0; y < HEIGHT; y++)
+   {
+      png_read_row(png_ptr, row, NULL);
+
+      if (memcmp(row, image[y], ROWBYTES) != 0)
+      {
+         fprintf(stderr, "pngrestart: sequential: row %d differs\n", y);
+         png_error(png_ptr, "image mismatch");
+      }
+   }
+
+   png_read_end(png_ptr, info_ptr);
+   num = png_get_restart_points(png_ptr, info_ptr, &points);
+   result = check_points("sequential", num, points);
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   free(row);
+   return result;
+}
+
+#ifdef PNG_READ_USER_CHUNKS_SUPPORTED
+static int PNGCBAPI
+user_chunk(png_structp png_ptr, png_unknown_chunkp chunk)
+{
+   (void)png_ptr;
+   (void)chunk;
+   return 1; /* handled */
+}
+#endif
+
+/* Read the file without checking the image and return the number of restart
+ * points, or -1 if the read failed.
+ */
+static long
+count_points(buffer *b, int user_chunks)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_byte row[ROWBYTES];
+   png_const_uint_32p points = NULL;
+   long num;
+   int y;
+
+   b->read = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngrestart: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      return -1;
+   }
+
+   png_set_read_fn(png_ptr, b, buffer_read);
+#ifdef PNG_READ_USER_CHUNKS_SUPPORTED
+   if (user_chunks != 0)
+      png_set_read_user_chunk_fn(png_ptr, NULL, user_chunk);
+#else
+   (void)user_chunks;
+#endif
+   png_read_info(png_ptr, info_ptr);
+
+   for (y = 0; y < HEIGHT; y++)
+      png_read_row(png_ptr, row, NULL);
+
+   png_read_end(png_ptr, info_ptr);
+   num = (long)png_get_restart_points(png_ptr, info_ptr, &points);
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return num;
+}
+
+/* Move the last restart point past the end of the IDAT data, fixing up the
+ * chunk CRC so that only the offset check can reject it.  The reST chunk is
+ * the one before IEND.
+ */
+static int
+check_damaged(buffer *b)
+{
+   png_bytep chunk = b->data + b->size - 12;
+   png_uint_32 length;
+   long num;
+
+   while (memcmp(chunk + 4, "reST", 4) != 0)
+   {
+      if (chunk <= b->data + 8)
+      {
+         fprintf(stderr, "pngrestart: no reST chunk\n");
+         return 1;
+      }
+
+      --chunk;
+   }
+
+   length = png_get_uint_32(chunk);
+   png_save_uint_32(chunk + 4 + length, 0x7fffffffU);
+   png_save_uint_32(chunk + 8 + length,
+       (png_uint_32)crc32(0, chunk + 4, (uInt)length + 4));
+
+   num = count_points(b, 0);
+
+   if (num != 0)
+   {
+      fprintf(stderr, "pngrestart: damaged reST: %ld restart points\n", num);
+      return 1;
+   }
+
+   return 0;
+}
+
+static int progressive_rows;
+
+static void PNGCBAPI
+progressive_info(png_structp png_ptr, png_infop info_ptr)
+{
+   (void)info_ptr;
+   png_start_read_image(png_ptr);
+}
+
+static void PNGCBAPI
+progressive_row(png_structp png_ptr, png_bytep row, png_uint_32 y, int pass)
+{
+   (void)pass;
+
+   if (row != NULL)
+   {
+      if (memcmp(row, image[y], ROWBYTES) != 0)
+      {
+         fprintf(stderr, "pngrestart: progressive: row %lu differs\n",
+             (unsigned long)y);
+         png_error(png_ptr, "image mismatch");
+      }
+
+      ++progressive_rows;
+   }
+}
+
+static int
+read_progressive(buffer *b)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_const_uint_32p points = NULL;
+   png_uint_32 num;
+   size_t offset;
+   int result;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngrestart: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      return 1;
+   }
+
+   progressive_rows = 0;
+   png_set_progressive_read_fn(png_ptr, NULL, progressive_info,
+       progressive_row, NULL);
+
+   /* Odd sized pieces to split the reST chunk as well */
+   for (offset = 0; offset < b->size; offset += 97)
+   {
+      size_t size = b->size - offset;
+
+      if (size > 97)
+         size = 97;
+
+      png_process_data(png_ptr, info_ptr, b->data + offset, size);
+   }
+
+   if (progressive_rows != HEIGHT)
+   {
+      fprintf(stderr, "pngrestart: progressive: %d rows\n", progressive_rows);
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      return 1;
+   }
+
+   num = png_get_restart_points(png_ptr, info_ptr, &points);
+   result = check_points("progressive", num, points);
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return result;
+}
+
+static int
+paeth(int a, int b, int c)
+{
+   int p = a + b - c;
+   int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+   if (pa <= pb && pa <= pc)
+      return a;
+
+   return pb <= pc ? b : c;
+}
+
+/* Undo the filter on one row; 'prev' is NULL for the first row of a strip,
+ * which the writer restricts to the filters that do not need it.
+ */
+static int
+unfilter(int filter, png_bytep row, png_const_bytep prev)
+{
+   int x;
+
+   if (prev == NULL && filter > PNG_FILTER_VALUE_SUB)
+      return 1;
+
+   for (x = 0; x < ROWBYTES; x++)
+   {
+      int a = x >= BPP ? row[x-BPP] : 0;
+      int b = prev != NULL ? prev[x] : 0;
+      int c = prev != NULL && x >= BPP ? prev[x-BPP] : 0;
+
+      switch (filter)
+      {
+         case PNG_FILTER_VALUE_NONE:  break;
+         case PNG_FILTER_VALUE_SUB:   row[x] = (png_byte)(row[x] + a); break;
+         case PNG_FILTER_VALUE_UP:    row[x] = (png_byte)(row[x] + b); break;
+         case PNG_FILTER_VALUE_AVG:   row[x] = (png_byte)(row[x] + (a+b)/2);
+                                      break;
+         case PNG_FILTER_VALUE_PAETH: row[x] = (png_byte)(row[x] +
+                                          paeth(a, b, c));
+                                      break;
+         default:                     return 1;
+      }
+   }
+
+   return 0;
+}
+
+/* Decode each strip on its own, as a parallel decoder would, from the restart
+ * points found by the sequential reader.  The IDAT data is first gathered into
+ * one zlib stream; the offsets in the reST chunk are positions in that stream.
+ */
+static int
+decode_strips(buffer *b)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_const_uint_32p points = NULL;
+   png_uint_32 num, i;
+   png_bytep idat;
+   size_t idat_size = 0, pos;
+   int result = 0;
+
+   /* Collect the IDAT data, skipping the signature */
+   idat = (png_bytep)malloc(b->size);
+
+   if (idat == NULL)
+   {
+      fprintf(stderr, "pngrestart: out of memory\n");
+      exit(1);
+   }
+
+   for (pos = 8; pos + 12 <= b->size;)
+   {
+      png_uint_32 length = png_get_uint_32(b->data + pos);
+
+      if (memcmp(b->data + pos + 4, "IDAT", 4) == 0)
+      {
+         memcpy(idat + idat_size, b->data + pos + 8, length);
+         idat_size += length;
+      }
+
+      pos += 12 + (size_t)length;
+   }
+
+   /* Read the points again; the structs are kept until the decode is done. */
+   b->read = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngrestart: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      free(idat);
+      return 1;
+   }
+
+   png_set_read_fn(png_ptr, b, buffer_read);
+   png_read_info(png_ptr, info_ptr);
+   {
+      png_byte row[ROWBYTES];
+      int y;
+
+      for (y = 0; y < HEIGHT; y++)
+         png_read_row(png_ptr, row, NULL);
+   }
+   png_read_end(png_ptr, info_ptr);
+   num = png_get_restart_points(png_ptr, info_ptr, &points);
+
+   for (i = 0; i < num && result == 0; i++)
+   {
+      png_uint_32 first = points[2*i];
+      png_uint_32 last = i+1 < num ? points[2*i + 2] : HEIGHT;
+      png_uint_32 y;
+      png_byte rows[2][ROWBYTES + 1];
+      z_stream z;
+
+      memset(&z, 0, sizeof z);
+
+      /* Raw inflate: there is no zlib header at a restart point and the
+       * Adler-32 at the end of the stream covers all of the data, so it cannot
+       * be checked from here.
+       */
+      if (points[2*i + 1] >= idat_size || inflateInit2(&z, -15) != Z_OK)
+      {
+         fprintf(stderr, "pngrestart: strip %lu: bad offset\n",
+             (unsigned long)i);
+         result = 1;
+         break;
+      }
+
+      z.next_in = idat + points[2*i + 1];
+      z.avail_in = (uInt)(idat_size - points[2*i + 1]);
+
+      for (y = first; y < last; y++)
+      {
+         png_bytep row = rows[y & 1];
+         int ret;
+
+         z.next_out = row;
+         z.avail_out = ROWBYTES + 1;
+         ret = inflate(&z, Z_SYNC_FLUSH);
+
+         if ((ret != Z_OK && ret != Z_STREAM_END) || z.avail_out != 0 ||
+             unfilter(row[0], row + 1, y > first ? rows[(y-1) & 1] + 1 : NULL)
+             != 0 || memcmp(row + 1, image[y], ROWBYTES) != 0)
+         {
+            fprintf(stderr, "pngrestart: strip %lu: row %lu wrong\n",
+                (unsigned long)i, (unsigned long)y);
+            result = 1;
+            break;
+         }
+      }
+
+      inflateEnd(&z);
+   }
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   free(idat);
+   return result;
+}
+
+int
+main(void)
+{
+   buffer file;
+   int result;
+
+   make_image();
+
+   if (make_png(&file) != 0)
+   {
+      fprintf(stderr, "pngrestart: write failed\n");
+      return 1;
+   }
+
+   result = read_sequential(&file);
+   result |= read_progressive(&file);
+   result |= decode_strips(&file);
+
+#ifdef PNG_READ_USER_CHUNKS_SUPPORTED
+   if (count_points(&file, 1) != 0)
+   {
+      fprintf(stderr, "pngrestart: reST not given to the user callback\n");
+      result = 1;
+   }
+#endif
+
+   result |= check_damaged(&file);
+
+   free(file.data);
+
+   if (result != 0)
+   {
+      fprintf(stderr, "pngrestart: failed\n");
+      return 1;
+   }
+
+   return 0;
+}
+#else /* !WRITE_reST || !READ_reST || !SEQUENTIAL_READ || !PROGRESSIVE */
+int
+main(void)
+{
+   fprintf(stderr, " test ignored: no support for restart points\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
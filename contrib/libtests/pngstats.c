@@ -0,0 +1,383 @@
+/* pngstats.c - test the pipeline statistics
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  It
+ *   needs libpng to be built with the PIPELINE_STATS option, which is off by
+ *   default; build with DFA_XTRA set to contrib/conftest/pipestats.dfa to run
+ *   it.  It writes and reads back an RGB image with png_set_bgr and the SUB
+ *   filter, so that every stage is used for every row, and checks that:
+ *
+ *   1) the calls and bytes of each stage are those expected from the image
+ *      size, the chunks in the file and the calls to the I/O functions,
+ *   2) with a clock that advances by one on each call every stage adds one
+ *      tick per call, so no stage is timed inside another, and without a
+ *      clock no ticks are counted,
+ *   3) png_set_pipeline_stats_clock resets the counters, and
+ *   4) png_get_pipeline_stats rejects an invalid stage.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_PIPELINE_STATS_SUPPORTED) &&\
+   defined(PNG_SEQUENTIAL_READ_SUPPORTED) &&\
+   defined(PNG_READ_BGR_SUPPORTED) && defined(PNG_WRITE_BGR_SUPPORTED) &&\
+   defined(PNG_WRITE_FILTER_SUPPORTED)
+
+#define WIDTH  37
+#define HEIGHT 29
+#define ROWBYTES (WIDTH * 3)
+
+#include "pngmembuf.h"
+
+static png_byte image[HEIGHT][ROWBYTES];
+
+static const char *stage_name[PNG_STAGE_COUNT] =
+{
+   "io", "crc", "zlib", "filter", "transform", "combine"
+};
+
+/* A file with a count of the calls to read or write it.  'file' must be first;
+ * buffer_read and buffer_write use the io_ptr as a buffer.
+ */
+typedef struct
+{
+   buffer        file;
+   png_uint_32   calls;
+} counted;
+
+/* The expected counts of one stage; a stage where 'calls' is ANY_CALLS may be
+ * called any non-zero number of times.
+ */
+#define ANY_CALLS 0xffffffffU
+
+typedef struct
+{
+   png_uint_32      calls;
+   png_alloc_size_t bytes;
+} expected;
+
+static png_uint_32 clock_now;
+
+static png_uint_32 PNGCBAPI
+fake_clock(png_structp png_ptr)
+{
+   (void)png_ptr;
+   return ++clock_now;
+}
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   fprintf(stderr, "pngstats: %s\n", message);
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)png_ptr;
+   (void)message;
+}
+
+static void PNGCBAPI
+counted_write(png_structp png_ptr, png_bytep data, size_t size)
+{
+   ++((counted*)png_get_io_ptr(png_ptr))->calls;
+   buffer_write(png_ptr, data, size);
+}
+
+static void PNGCBAPI
+counted_read(png_structp png_ptr, png_bytep data, size_t size)
+{
+   ++((counted*)png_get_io_ptr(png_ptr))->calls;
+   buffer_read(png_ptr, data, size);
+}
+
+static void
+make_image(void)
+{
+   png_uint_32 x, y;
+   png_uint_32 h = 1;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < ROWBYTES; ++x)
+      {
+         h = h * 1103515245U + 12345U;
+         image[y][x] = (png_byte)(h >> 24);
+      }
+}
+
+/* The bytes covered by the chunk CRCs: the type and data of every chunk. */
+static png_alloc_size_t
+crc_bytes(const buffer *b)
+{
+   png_alloc_size_t total = 0;
+   size_t offset = 8;
+
+   while (offset + 12 <= b->size)
+   {
+      png_uint_32 length = png_get_uint_32(b->data + offset);
+
+      total += 4 + length;
+      offset += 12 + length;
+   }
+
+   return total;
+}
+
+/* Check the counters of every stage against 'expect'.  With the fake clock
+ * each call adds one tick, otherwise there are no ticks.
+ */
+static int
+check_stats(png_structp png_ptr, const char *what, const expected *expect,
+   int clocked)
+{
+   int stage, errors = 0;
+
+   for (stage = 0; stage < PNG_STAGE_COUNT; ++stage)
+   {
+      png_uint_32 calls = 0;
+      png_alloc_size_t bytes = 0, ticks = 0;
+
+      if (!png_get_pipeline_stats(png_ptr, stage, &calls, &bytes, &ticks))
+      {
+         fprintf(stderr, "pngstats: %s %s: stage rejected\n", what,
+            stage_name[stage]);
+         ++errors;
+         continue;
+      }
+
+      if (expect[stage].calls == ANY_CALLS ? calls == 0 :
+          calls != expect[stage].calls)
+      {
+         fprintf(stderr, "pngstats: %s %s: %lu calls\n", what,
+            stage_name[stage], (unsigned long)calls);
+         ++errors;
+      }
+
+      if (bytes != expect[stage].bytes)
+      {
+         fprintf(stderr, "pngstats: %s %s: %lu bytes, expected %lu\n", what,
+            stage_name[stage], (unsigned long)bytes,
+            (unsigned long)expect[stage].bytes);
+         ++errors;
+      }
+
+      if (ticks != (clocked ? calls : 0))
+      {
+         fprintf(stderr, "pngstats: %s %s: %lu ticks for %lu calls\n", what,
+            stage_name[stage], (unsigned long)ticks, (unsigned long)calls);
+         ++errors;
+      }
+   }
+
+   return errors;
+}
+
+/* After png_set_pipeline_stats_clock every counter is zero */
+static int
+check_reset(png_structp png_ptr, const char *what)
+{
+   static const expected zero[PNG_STAGE_COUNT];
+   int errors;
+
+   png_set_pipeline_stats_clock(png_ptr, NULL);
+   errors = check_stats(png_ptr, what, zero, 0);
+
+   if (png_get_pipeline_stats(png_ptr, -1, NULL, NULL, NULL) ||
+       png_get_pipeline_stats(png_ptr, PNG_STAGE_COUNT, NULL, NULL, NULL))
+   {
+      fprintf(stderr, "pngstats: %s: invalid stage accepted\n", what);
+      ++errors;
+   }
+
+   return errors;
+}
+
+static int
+write_png(counted *out)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   int errors = 0;
+   expected expect[PNG_STAGE_COUNT];
+
+   memset(out, 0, sizeof *out);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngstats: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      fprintf(stderr, "pngstats: failed to write test image\n");
+      exit(1);
+   }
+
+   clock_now = 0;
+   png_set_pipeline_stats_clock(png_ptr, fake_clock);
+   png_set_write_fn(png_ptr, out, counted_write, buffer_flush);
+   png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+   png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+   png_write_info(png_ptr, info_ptr);
+   png_set_bgr(png_ptr);
+
+   for (y = 0; y < HEIGHT; ++y)
+      png_write_row(png_ptr, image[y]);
+
+   png_write_end(png_ptr, info_ptr);
+
+   expect[PNG_STAGE_IO].calls = out->calls;
+   expect[PNG_STAGE_IO].bytes = out->file.size;
+   expect[PNG_STAGE_CRC].calls = ANY_CALLS;
+   expect[PNG_STAGE_CRC].bytes = crc_bytes(&out->file);
+   expect[PNG_STAGE_ZLIB].calls = ANY_CALLS;
+   expect[PNG_STAGE_ZLIB].bytes = HEIGHT * (ROWBYTES + 1);
+   expect[PNG_STAGE_FILTER].calls = HEIGHT;
+   expect[PNG_STAGE_FILTER].bytes = HEIGHT * ROWBYTES;
+   expect[PNG_STAGE_TRANSFORM].calls = HEIGHT;
+   expect[PNG_STAGE_TRANSFORM].bytes = HEIGHT * ROWBYTES;
+   expect[PNG_STAGE_COMBINE].calls = 0;
+   expect[PNG_STAGE_COMBINE].bytes = 0;
+
+   errors += check_stats(png_ptr, "write", expect, 1);
+   errors += check_reset(png_ptr, "write reset");
+
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   return errors;
+}
+
+static int
+read_png(counted *in, int clocked)
+{
+   static png_byte row[ROWBYTES];
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   int errors = 0;
+   const char *what = clocked ? "read" : "read without clock";
+   expected expect[PNG_STAGE_COUNT];
+
+   in->file.read = 0;
+   in->calls = 0;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      return 1;
+   }
+
+   clock_now = 0;
+
+   if (clocked)
+      png_set_pipeline_stats_clock(png_ptr, fake_clock);
+
+   png_set_read_fn(png_ptr, in, counted_read);
+   png_read_info(png_ptr, info_ptr);
+   png_set_bgr(png_ptr);
+   png_read_update_info(png_ptr, info_ptr);
+
+   for (y = 0; y < HEIGHT; ++y)
+   {
+      png_read_row(png_ptr, row, NULL);
+
+      if (memcmp(row, image[y], ROWBYTES) != 0)
+      {
+         fprintf(stderr, "pngstats: %s: row %lu differs\n", what,
+            (unsigned long)y);
+         ++errors;
+         break;
+      }
+   }
+
+   png_read_end(png_ptr, info_ptr);
+
+   expect[PNG_STAGE_IO].calls = in->calls;
+   expect[PNG_STAGE_IO].bytes = in->file.size;
+   expect[PNG_STAGE_CRC].calls = ANY_CALLS;
+   expect[PNG_STAGE_CRC].bytes = crc_bytes(&in->file);
+   expect[PNG_STAGE_ZLIB].calls = ANY_CALLS;
+   expect[PNG_STAGE_ZLIB].bytes = HEIGHT * (ROWBYTES + 1);
+   expect[PNG_STAGE_FILTER].calls = HEIGHT;
+   expect[PNG_STAGE_FILTER].bytes = HEIGHT * ROWBYTES;
+   expect[PNG_STAGE_TRANSFORM].calls = HEIGHT;
+   expect[PNG_STAGE_TRANSFORM].bytes = HEIGHT * ROWBYTES;
+   expect[PNG_STAGE_COMBINE].calls = HEIGHT;
+   expect[PNG_STAGE_COMBINE].bytes = HEIGHT * ROWBYTES;
+
+   errors += check_stats(png_ptr, what, expect, clocked);
+   errors += check_reset(png_ptr, "read reset");
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return errors;
+}
+
+int
+main(void)
+{
+   counted file;
+   int errors = 0;
+
+   make_image();
+   errors += write_png(&file);
+   errors += read_png(&file, 1);
+   errors += read_png(&file, 0);
+
+   free(file.file.data);
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pngstats: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(PIPELINE_STATS && SEQUENTIAL_READ && BGR && WRITE_FILTER) */
+int
+main(void)
+{
+   fprintf(stderr,
+      " test ignored: libpng built without the PIPELINE_STATS option\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
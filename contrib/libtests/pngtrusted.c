@@ -0,0 +1,403 @@
+/* pngtrusted.c - test png_set_trusted_input
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * NOTES:
+ *   This is a C program that is intended to be linked against libpng.  It
+ *   writes an RGB image with a tEXt chunk and a single IDAT chunk to memory,
+ *   damages copies of it and checks that:
+ *
+ *   1) a reader with the default settings rejects a bad chunk CRC and a bad
+ *      zlib Adler-32 while a reader with png_set_trusted_input reads the
+ *      same pixels as from the undamaged file,
+ *   2) a chunk length beyond the end of the data is still an error with
+ *      png_set_trusted_input, and
+ *   3) png_set_trusted_input is an application error on a write struct and
+ *      the CRCs of the file written are still correct.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <setjmp.h>
+
+/* Define the following to use this test against your installed libpng, rather
+ * than the one being built here:
+ */
+#ifdef PNG_FREESTANDING_TESTS
+#  include <png.h>
+#else
+#  include "../../png.h"
+#endif
+
+/* 77 indicates a skipped test to the configure test harness */
+#if defined(HAVE_CONFIG_H)
+#  define SKIP 77
+#else
+#  define SKIP 0
+#endif
+
+#if defined(PNG_SEQUENTIAL_READ_SUPPORTED) && defined(PNG_WRITE_SUPPORTED) &&\
+   defined(PNG_BENIGN_ERRORS_SUPPORTED) && defined(PNG_TEXT_SUPPORTED)
+
+#define WIDTH  37
+#define HEIGHT 29
+#define ROWBYTES (WIDTH * 3)
+
+#include "pngmembuf.h"
+
+static png_byte image[HEIGHT][ROWBYTES];
+
+static void PNGCBAPI
+error_fn(png_structp png_ptr, png_const_charp message)
+{
+   fprintf(stderr, "pngtrusted: %s\n", message);
+   png_longjmp(png_ptr, 1);
+}
+
+static void PNGCBAPI
+expected_error_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)message;
+   png_longjmp(png_ptr, 1);
+}
+
+/* Warnings are counted through the error pointer */
+static void PNGCBAPI
+warning_fn(png_structp png_ptr, png_const_charp message)
+{
+   (void)message;
+   ++*(int*)png_get_error_ptr(png_ptr);
+}
+
+static void
+make_image(void)
+{
+   png_uint_32 x, y;
+   png_uint_32 h = 1;
+
+   for (y = 0; y < HEIGHT; ++y)
+      for (x = 0; x < ROWBYTES; ++x)
+      {
+         h = h * 1103515245U + 12345U;
+         image[y][x] = (png_byte)(h >> 24);
+      }
+}
+
+/* The CRC of a chunk; this keeps the test independent of zlib.h */
+static png_uint_32
+chunk_crc(png_const_bytep data, size_t length)
+{
+   png_uint_32 crc = 0xffffffffU;
+
+   while (length-- > 0)
+   {
+      int bit;
+
+      crc ^= *data++;
+
+      for (bit = 0; bit < 8; ++bit)
+         crc = (crc >> 1) ^ (0xedb88320U & (0U - (crc & 1)));
+   }
+
+   return crc ^ 0xffffffffU;
+}
+
+/* The offset of the length field of the first chunk of the given type */
+static size_t
+find_chunk(const buffer *b, const char *type)
+{
+   size_t offset = 8;
+
+   while (offset + 12 <= b->size)
+   {
+      if (memcmp(b->data + offset + 4, type, 4) == 0)
+         return offset;
+
+      offset += 12 + png_get_uint_32(b->data + offset);
+   }
+
+   fprintf(stderr, "pngtrusted: no %s chunk\n", type);
+   exit(1);
+}
+
+static png_uint_32
+chunk_length(const buffer *b, size_t offset)
+{
+   return png_get_uint_32(b->data + offset);
+}
+
+/* Recalculate the CRC of the chunk at offset */
+static void
+set_crc(buffer *b, size_t offset)
+{
+   png_uint_32 length = chunk_length(b, offset);
+
+   png_save_uint_32(b->data + offset + 8 + length,
+      chunk_crc(b->data + offset + 4, 4 + length));
+}
+
+static void
+copy_buffer(buffer *to, const buffer *from)
+{
+   *to = *from;
+   to->data = (png_bytep)malloc(from->size);
+
+   if (to->data == NULL)
+   {
+      fprintf(stderr, "pngtrusted: out of memory\n");
+      exit(1);
+   }
+
+   memcpy(to->data, from->data, from->size);
+   to->allocated = from->size;
+}
+
+/* Write the image, calling png_set_trusted_input on the write struct if
+ * 'trusted' is set.  With 'benign' the resulting app error is a warning,
+ * otherwise the write fails.  Returns the number of warnings or -1 on error.
+ */
+static int
+write_png(buffer *b, int trusted, int benign)
+{
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   png_text text;
+   volatile int warnings = 0;
+
+   memset(b, 0, sizeof *b);
+   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+      (png_voidp)&warnings, trusted && !benign ? expected_error_fn : error_fn,
+      warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+   {
+      fprintf(stderr, "pngtrusted: out of memory\n");
+      exit(1);
+   }
+
+   if (setjmp(png_jmpbuf(png_ptr)))
+   {
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      return -1;
+   }
+
+   png_set_benign_errors(png_ptr, benign);
+
+   if (trusted)
+      png_set_trusted_input(png_ptr, 1);
+
+   png_set_write_fn(png_ptr, b, buffer_write, buffer_flush);
+   /* Big enough for all the image data to go in one IDAT chunk */
+   png_set_compression_buffer_size(png_ptr, 65536);
+   png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+   memset(&text, 0, sizeof text);
+   text.compression = PNG_TEXT_COMPRESSION_NONE;
+   text.key = (png_charp)"Comment";
+   text.text = (png_charp)"pngtrusted";
+   png_set_text(png_ptr, info_ptr, &text, 1);
+
+   png_write_info(png_ptr, info_ptr);
+
+   for (y = 0; y < HEIGHT; ++y)
+      png_write_row(png_ptr, image[y]);
+
+   png_write_end(png_ptr, info_ptr);
+   png_destroy_write_struct(&png_ptr, &info_ptr);
+   return warnings;
+}
+
+/* Read the file with benign errors treated as errors.  Returns 0 if the read
+ * succeeded without warnings and the pixels are right, 1 otherwise.
+ */
+static int
+read_png(buffer *b, int trusted)
+{
+   static png_byte row[ROWBYTES];
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 y;
+   volatile int warnings = 0;
+   volatile int failed = 1;
+
+   b->read = 0;
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)&warnings,
+      expected_error_fn, warning_fn);
+   info_ptr = png_create_info_struct(png_ptr);
+
+   if (info_ptr == NULL)
+      return 1;
+
+   if (setjmp(png_jmpbuf(png_ptr)) == 0)
+   {
+      png_set_benign_errors(png_ptr, 0/*error*/);
+
+      if (trusted)
+         png_set_trusted_input(png_ptr, 1);
+
+      png_set_read_fn(png_ptr, b, buffer_read);
+      png_read_info(png_ptr, info_ptr);
+
+      failed = 0;
+
+      for (y = 0; y < HEIGHT; ++y)
+      {
+         png_read_row(png_ptr, row, NULL);
+         failed |= memcmp(row, image[y], ROWBYTES) != 0;
+      }
+
+      png_read_end(png_ptr, info_ptr);
+   }
+
+   else
+      failed = 1;
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+   return failed || warnings != 0;
+}
+
+/* The default reader must reject the file and the trusted reader read it */
+static int
+check_damaged(buffer *b, const char *what)
+{
+   int errors = 0;
+
+   if (read_png(b, 0) == 0)
+   {
+      fprintf(stderr, "pngtrusted: %s: accepted by the default reader\n", what);
+      ++errors;
+   }
+
+   if (read_png(b, 1) != 0)
+   {
+      fprintf(stderr, "pngtrusted: %s: not read with trusted input\n", what);
+      ++errors;
+   }
+
+   return errors;
+}
+
+/* Both readers must fail cleanly */
+static int
+check_invalid(buffer *b, const char *what)
+{
+   int errors = 0;
+
+   if (read_png(b, 0) == 0)
+   {
+      fprintf(stderr, "pngtrusted: %s: accepted by the default reader\n", what);
+      ++errors;
+   }
+
+   if (read_png(b, 1) == 0)
+   {
+      fprintf(stderr, "pngtrusted: %s: accepted with trusted input\n", what);
+      ++errors;
+   }
+
+   return errors;
+}
+
+int
+main(void)
+{
+   buffer file, damaged;
+   size_t idat, text;
+   int errors = 0;
+
+   make_image();
+
+   if (write_png(&file, 0, 0) != 0)
+   {
+      fprintf(stderr, "pngtrusted: failed to write test image\n");
+      return 1;
+   }
+
+   idat = find_chunk(&file, "IDAT");
+   text = find_chunk(&file, "tEXt");
+
+   if (read_png(&file, 0) != 0 || read_png(&file, 1) != 0)
+   {
+      fprintf(stderr, "pngtrusted: undamaged file not read\n");
+      ++errors;
+   }
+
+   /* A bad CRC on the critical IDAT chunk */
+   copy_buffer(&damaged, &file);
+   damaged.data[idat + 8 + chunk_length(&file, idat)] ^= 1;
+   errors += check_damaged(&damaged, "IDAT CRC");
+   free(damaged.data);
+
+   /* A bad CRC on the ancillary tEXt chunk, which is a warning by default */
+   copy_buffer(&damaged, &file);
+   damaged.data[text + 8 + chunk_length(&file, text)] ^= 1;
+   errors += check_damaged(&damaged, "tEXt CRC");
+   free(damaged.data);
+
+#  if PNG_ZLIB_VERNUM >= 0x1290 /* inflateValidate */
+   /* A bad Adler-32 at the end of the zlib stream, with a good CRC */
+   copy_buffer(&damaged, &file);
+   damaged.data[idat + 7 + chunk_length(&file, idat)] ^= 1;
+   set_crc(&damaged, idat);
+   errors += check_damaged(&damaged, "Adler-32");
+   free(damaged.data);
+#  endif
+
+   /* Chunk lengths that run past the end of the file are not checked with
+    * trusted input, but reading the chunk still fails.
+    */
+   copy_buffer(&damaged, &file);
+   png_save_uint_32(damaged.data + idat, 0x7fffffffU);
+   errors += check_invalid(&damaged, "IDAT length");
+   free(damaged.data);
+
+   copy_buffer(&damaged, &file);
+   png_save_uint_32(damaged.data + text, (png_uint_32)file.size);
+   errors += check_invalid(&damaged, "tEXt length");
+   free(damaged.data);
+
+   /* On a write struct png_set_trusted_input is an app error and, if that is
+    * only a warning, has no effect on the CRCs.
+    */
+   if (write_png(&damaged, 1, 0) != -1)
+   {
+      fprintf(stderr, "pngtrusted: accepted on a write struct\n");
+      ++errors;
+   }
+
+   free(damaged.data);
+
+   if (write_png(&damaged, 1, 1) != 1 || damaged.size != file.size ||
+       memcmp(damaged.data, file.data, file.size) != 0)
+   {
+      fprintf(stderr, "pngtrusted: write struct output changed\n");
+      ++errors;
+   }
+
+   free(damaged.data);
+   free(file.data);
+
+   if (errors != 0)
+   {
+      fprintf(stderr, "pngtrusted: %d tests failed\n", errors);
+      return 1;
+   }
+
+   return 0;
+}
+
+#else /* !(SEQUENTIAL_READ && WRITE && BENIGN_ERRORS && TEXT) */
+int
+main(void)
+{
+   fprintf(stderr, " test ignored: no read, write or text support\n");
+   /* So the test is skipped: */
+   return SKIP;
+}
+#endif
@@ -21,6 +21,8 @@
 #     "make -j$(nproc) libpng16.la").
 # 2. Disabled WARNING and WRITE options in pnglibconf.dfa.
 # 3. Build zlib alongside libpng
+#
+# Added libpng_perf_fuzzer, which needs the PIPELINE_STATS option.
 ################################################################################
 
 # Disable logging via library build configuration control.
@@ -28,6 +30,7 @@ cat scripts/pnglibconf.dfa | \
   sed -e "s/option STDIO/option STDIO disabled/" \
       -e "s/option WARNING /option WARNING disabled/" \
       -e "s/option WRITE enables WRITE_INT_FUNCTIONS/option WRITE disabled/" \
+      -e "s/option PIPELINE_STATS disabled/option PIPELINE_STATS/" \
 > scripts/pnglibconf.dfa.temp
 mv scripts/pnglibconf.dfa.temp scripts/pnglibconf.dfa
 
@@ -43,9 +46,17 @@ $CXX $CXXFLAGS -std=c++11 -I. \
      -o $OUT/libpng_read_fuzzer \
      -lFuzzingEngine .libs/libpng16.a -lz
 
+# build libpng_perf_fuzzer.
+$CXX $CXXFLAGS -std=c++11 -I. \
+     $SRC/libpng/contrib/oss-fuzz/libpng_perf_fuzzer.cc \
+     -o $OUT/libpng_perf_fuzzer \
+     -lFuzzingEngine .libs/libpng16.a -lz
+
 # add seed corpus.
 find $SRC/libpng -name "*.png" | grep -v crashers | \
      xargs zip $OUT/libpng_read_fuzzer_seed_corpus.zip
+cp $OUT/libpng_read_fuzzer_seed_corpus.zip \
+     $OUT/libpng_perf_fuzzer_seed_corpus.zip
 
 cp $SRC/libpng/contrib/oss-fuzz/*.dict \
      $SRC/libpng/contrib/oss-fuzz/*.options $OUT/
@@ -0,0 +1,371 @@
+// libpng_perf_fuzzer.cc
+//
+// This code is released under the libpng license.
+// For conditions of distribution and use, see the disclaimer
+// and license in png.h
+
+// A fuzz target that looks for inputs which make libpng do a lot of work for
+// their size; these never crash but can still be used to tie up a server.  It
+// decodes the input in the same way as libpng_read_fuzzer.cc, then counts:
+//
+// 1. the bytes produced by inflate, for the image and for zTXt, iTXt and iCCP,
+// 2. the rows unfiltered and the bytes in them,
+// 3. the calls to the row transforms and the bytes they produced,
+// 4. the rows returned to the application.
+//
+// The "work" is the total of the byte counts plus kRowCost for each row, since
+// every row has a fixed overhead however narrow it is.  An input doing more than
+// the threshold (default kDefaultThreshold, or $PNG_PERF_THRESHOLD) work per
+// input byte is reported and, when fuzzing, treated as a crash.
+//
+// The counts come from the PIPELINE_STATS option, which must be enabled in the
+// libpng build (build.sh does this).
+//
+// Compiled with -DPNG_PERF_STANDALONE this file is instead a corpus runner that
+// does not need a fuzzing engine:
+//
+//    libpng_perf_runner [--threshold N] [--verbose] file-or-directory...
+//
+// It prints a line for each slow input (every input with --verbose) and exits
+// with status 1 if any input was slow.
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PNG_PERF_STANDALONE
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#endif
+
+#include "png.h"
+
+#ifndef PNG_PIPELINE_STATS_SUPPORTED
+#error "libpng_perf_fuzzer requires libpng built with the PIPELINE_STATS option"
+#endif
+
+namespace {
+
+// The fixed cost of one row, in the same units as a byte of data.  Decoding a
+// 1 pixel wide image takes as long per row as 160 or more bytes of a wide one.
+const png_alloc_size_t kRowCost = 160;
+
+// The default limit on work per input byte.  The deflate format cannot expand
+// data by more than about 1032:1 and the transforms below expand a row at most
+// 32 times (1-bit palette to RGBA), so images with wide rows stay below this.
+const double kDefaultThreshold = 50000;
+
+struct BufState {
+  const uint8_t* data;
+  size_t bytes_left;
+};
+
+struct PerfCounts {
+  png_alloc_size_t inflated = 0;         // bytes from inflate
+  png_uint_32 filter_rows = 0;           // rows unfiltered
+  png_alloc_size_t filter_bytes = 0;
+  png_uint_32 transform_calls = 0;       // rows transformed
+  png_alloc_size_t transform_bytes = 0;
+  png_uint_32 rows = 0;                  // rows returned to the caller
+  png_alloc_size_t work = 0;
+};
+
+void user_read_data(png_structp png_ptr, png_bytep data, size_t length) {
+  BufState* buf_state = static_cast<BufState*>(png_get_io_ptr(png_ptr));
+  if (length > buf_state->bytes_left) {
+    png_error(png_ptr, "read error");
+  }
+  memcpy(data, buf_state->data, length);
+  buf_state->bytes_left -= length;
+  buf_state->data += length;
+}
+
+void* limited_malloc(png_structp, png_alloc_size_t size) {
+  // As libpng_read_fuzzer.cc; fail large allocations rather than let the
+  // fuzzer report them.
+  if (size > 8000000)
+    return nullptr;
+
+  return malloc(size);
+}
+
+void default_free(png_structp, png_voidp ptr) {
+  return free(ptr);
+}
+
+void silent_warning(png_structp, png_const_charp) {}
+
+void silent_error(png_structp png_ptr, png_const_charp) {
+  png_longjmp(png_ptr, 1);
+}
+
+// Add the decompressed size of the compressed text and the ICC profile.
+png_alloc_size_t CompressedChunkBytes(png_structp png_ptr, png_infop info_ptr) {
+  png_alloc_size_t total = 0;
+  png_textp text;
+  int num_text = 0;
+
+  if (png_get_text(png_ptr, info_ptr, &text, &num_text) > 0) {
+    for (int i = 0; i < num_text; ++i) {
+      if (text[i].compression == PNG_TEXT_COMPRESSION_zTXt)
+        total += text[i].text_length;
+      else if (text[i].compression == PNG_ITXT_COMPRESSION_zTXt)
+        total += text[i].itxt_length;
+    }
+  }
+
+  png_charp name;
+  int compression_type;
+  png_bytep profile;
+  png_uint_32 proflen;
+
+  if (png_get_iCCP(png_ptr, info_ptr, &name, &compression_type, &profile,
+                   &proflen) != 0)
+    total += proflen;
+
+  return total;
+}
+
+void CollectCounts(png_structp png_ptr, png_infop info_ptr,
+                   png_infop end_info_ptr, PerfCounts* counts) {
+  png_uint_32 calls;
+  png_alloc_size_t bytes;
+
+  png_get_pipeline_stats(png_ptr, PNG_STAGE_ZLIB, nullptr, &bytes, nullptr);
+  counts->inflated = bytes + CompressedChunkBytes(png_ptr, info_ptr) +
+                     CompressedChunkBytes(png_ptr, end_info_ptr);
+
+  png_get_pipeline_stats(png_ptr, PNG_STAGE_FILTER, &calls, &bytes, nullptr);
+  counts->filter_rows = calls;
+  counts->filter_bytes = bytes;
+
+  png_get_pipeline_stats(png_ptr, PNG_STAGE_TRANSFORM, &calls, &bytes,
+                         nullptr);
+  counts->transform_calls = calls;
+  counts->transform_bytes = bytes;
+
+  png_get_pipeline_stats(png_ptr, PNG_STAGE_COMBINE, &calls, nullptr, nullptr);
+  counts->rows = calls;
+
+  counts->work = counts->inflated + counts->filter_bytes +
+                 counts->transform_bytes +
+                 kRowCost * (png_alloc_size_t)counts->rows;
+}
+
+// Decode the input as libpng_read_fuzzer.cc does and return the counts; the
+// work done before an error is included.  Returns false if the input is not a
+// PNG file.
+bool MeasureInput(const uint8_t* data, size_t size, PerfCounts* counts) {
+  static const size_t kPngHeaderSize = 8;
+
+  if (size < kPngHeaderSize || png_sig_cmp(data, 0, kPngHeaderSize) != 0)
+    return false;
+
+  png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                               silent_error, silent_warning);
+  if (png_ptr == nullptr)
+    return false;
+
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  png_infop end_info_ptr = png_create_info_struct(png_ptr);
+  BufState buf_state = { data + kPngHeaderSize, size - kPngHeaderSize };
+
+  // Volatile because it is changed after the setjmp.
+  png_bytep volatile row_ptr = nullptr;
+
+  if (info_ptr == nullptr || end_info_ptr == nullptr) {
+    png_destroy_read_struct(&png_ptr, &info_ptr, &end_info_ptr);
+    return false;
+  }
+
+  png_set_mem_fn(png_ptr, nullptr, limited_malloc, default_free);
+  png_set_crc_action(png_ptr, PNG_CRC_QUIET_USE, PNG_CRC_QUIET_USE);
+#ifdef PNG_IGNORE_ADLER32
+  png_set_option(png_ptr, PNG_IGNORE_ADLER32, PNG_OPTION_ON);
+#endif
+  png_set_read_fn(png_ptr, &buf_state, user_read_data);
+  png_set_sig_bytes(png_ptr, kPngHeaderSize);
+
+  if (setjmp(png_jmpbuf(png_ptr)) == 0) {
+    png_read_info(png_ptr, info_ptr);
+
+    png_uint_32 width = png_get_image_width(png_ptr, info_ptr);
+    png_uint_32 height = png_get_image_height(png_ptr, info_ptr);
+
+    // The same limit as libpng_read_fuzzer.cc.
+    if (width == 0 || height <= 100000000 / width) {
+      png_set_gray_to_rgb(png_ptr);
+      png_set_expand(png_ptr);
+      png_set_packing(png_ptr);
+      png_set_scale_16(png_ptr);
+      png_set_tRNS_to_alpha(png_ptr);
+
+      int passes = png_set_interlace_handling(png_ptr);
+
+      png_read_update_info(png_ptr, info_ptr);
+
+      row_ptr = static_cast<png_bytep>(
+          png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr)));
+
+      for (int pass = 0; pass < passes; ++pass) {
+        for (png_uint_32 y = 0; y < height; ++y)
+          png_read_row(png_ptr, row_ptr, nullptr);
+      }
+
+      png_read_end(png_ptr, end_info_ptr);
+    }
+  }
+
+  CollectCounts(png_ptr, info_ptr, end_info_ptr, counts);
+
+  png_free(png_ptr, row_ptr);
+  png_destroy_read_struct(&png_ptr, &info_ptr, &end_info_ptr);
+  return true;
+}
+
+bool IsSlow(const PerfCounts& counts, size_t size, double threshold) {
+  return counts.work > threshold * size;
+}
+
+void Report(FILE* out, const char* name, size_t size,
+            const PerfCounts& counts) {
+  fprintf(out,
+          "%s: %lu bytes, work %.0f per byte (inflate %lu, filter %lu rows "
+          "%lu bytes, transform %lu calls %lu bytes, %lu rows)\n",
+          name, (unsigned long)size, (double)counts.work / size,
+          (unsigned long)counts.inflated, (unsigned long)counts.filter_rows,
+          (unsigned long)counts.filter_bytes,
+          (unsigned long)counts.transform_calls,
+          (unsigned long)counts.transform_bytes, (unsigned long)counts.rows);
+}
+
+}  // namespace
+
+#ifndef PNG_PERF_STANDALONE
+// Entry point for LibFuzzer.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static double threshold = 0;
+
+  if (threshold == 0) {
+    const char* env = getenv("PNG_PERF_THRESHOLD");
+    threshold = env != nullptr ? atof(env) : 0;
+    if (!(threshold > 0))
+      threshold = kDefaultThreshold;
+  }
+
+  PerfCounts counts;
+
+  if (MeasureInput(data, size, &counts) && IsSlow(counts, size, threshold)) {
+    Report(stderr, "slow input", size, counts);
+    abort();
+  }
+
+  return 0;
+}
+
+#else /* PNG_PERF_STANDALONE */
+namespace {
+
+bool ReadFile(const std::string& name, std::vector<uint8_t>* data) {
+  FILE* fp = fopen(name.c_str(), "rb");
+  if (fp == nullptr)
+    return false;
+
+  uint8_t buffer[65536];
+  size_t n;
+
+  data->clear();
+  while ((n = fread(buffer, 1, sizeof buffer, fp)) > 0)
+    data->insert(data->end(), buffer, buffer + n);
+
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  return ok;
+}
+
+// Expand directories (one level, sorted) into the files they contain.
+void AddInputs(const char* arg, std::vector<std::string>* inputs) {
+  struct stat st;
+
+  if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)) {
+    DIR* dir = opendir(arg);
+    std::vector<std::string> names;
+
+    if (dir != nullptr) {
+      struct dirent* entry;
+
+      while ((entry = readdir(dir)) != nullptr) {
+        std::string name = std::string(arg) + "/" + entry->d_name;
+
+        if (stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+          names.push_back(name);
+      }
+
+      closedir(dir);
+    }
+
+    std::sort(names.begin(), names.end());
+    inputs->insert(inputs->end(), names.begin(), names.end());
+  }
+
+  else
+    inputs->push_back(arg);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double threshold = kDefaultThreshold;
+  bool verbose = false;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+      threshold = atof(argv[++i]);
+    else if (strcmp(argv[i], "--verbose") == 0)
+      verbose = true;
+    else if (argv[i][0] == '-') {
+      fprintf(stderr,
+              "usage: %s [--threshold N] [--verbose] file-or-directory...\n",
+              argv[0]);
+      return 2;
+    } else
+      AddInputs(argv[i], &inputs);
+  }
+
+  int slow = 0, measured = 0;
+  std::vector<uint8_t> data;
+
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (!ReadFile(inputs[i], &data)) {
+      fprintf(stderr, "%s: cannot read\n", inputs[i].c_str());
+      continue;
+    }
+
+    PerfCounts counts;
+
+    if (!MeasureInput(data.data(), data.size(), &counts))
+      continue; /* not a PNG file */
+
+    ++measured;
+
+    if (IsSlow(counts, data.size(), threshold)) {
+      ++slow;
+      printf("SLOW ");
+      Report(stdout, inputs[i].c_str(), data.size(), counts);
+    } else if (verbose)
+      Report(stdout, inputs[i].c_str(), data.size(), counts);
+  }
+
+  printf("%d of %d inputs above %.0f work per byte\n", slow, measured,
+         threshold);
+  return slow > 0;
+}
+#endif /* PNG_PERF_STANDALONE */
@@ -12,6 +12,9 @@
  */
 
 #include "pngpriv.h"
+#if PNG_MMAP_READ_OPT > 0
+#  include <sys/mman.h>
+#endif
 
 /* Generate a compiler error if there is an old png.h in the search path. */
 typedef png_libpng_version_1_6_38_git Your_png_h_is_not_version_1_6_38_git;
@@ -140,7 +143,10 @@ png_calculate_crc(png_structrp png_ptr, png_const_bytep ptr, size_t length)
 {
    int need_crc = 1;
 
-   if (PNG_CHUNK_ANCILLARY(png_ptr->chunk_name) != 0)
+   if ((png_ptr->flags & PNG_FLAG_TRUSTED_INPUT) != 0)
+      need_crc = 0;
+
+   else if (PNG_CHUNK_ANCILLARY(png_ptr->chunk_name) != 0)
    {
       if ((png_ptr->flags & PNG_FLAG_CRC_ANCILLARY_MASK) ==
           (PNG_FLAG_CRC_ANCILLARY_USE | PNG_FLAG_CRC_ANCILLARY_NOWARN))
@@ -161,10 +167,13 @@ png_calculate_crc(png_structrp png_ptr, png_const_bytep ptr, size_t length)
    if (need_crc != 0 && length > 0)
    {
       uLong crc = png_ptr->crc; /* Should never issue a warning */
+      size_t remaining = length;
+
+      png_stats_begin(png_ptr, PNG_STAGE_CRC, 0);
 
       do
       {
-         uInt safe_length = (uInt)length;
+         uInt safe_length = (uInt)remaining;
 #ifndef __COVERITY__
          if (safe_length == 0)
             safe_length = (uInt)-1; /* evil, but safe */
@@ -177,15 +186,40 @@ png_calculate_crc(png_structrp png_ptr, png_const_bytep ptr, size_t length)
           * assumptions within the libpng code.
           */
          ptr += safe_length;
-         length -= safe_length;
+         remaining -= safe_length;
       }
-      while (length > 0);
+      while (remaining > 0);
 
       /* And the following is always safe because the crc is only 32 bits. */
       png_ptr->crc = (png_uint_32)crc;
+
+      png_stats_end(png_ptr, PNG_STAGE_CRC, length);
    }
 }
 
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+void /* PRIVATE */
+png_stats_begin(png_structrp png_ptr, int stage, png_alloc_size_t base)
+{
+   png_ptr->stats_base[stage] = base;
+
+   if (png_ptr->stats_clock_fn != NULL)
+      png_ptr->stats_start[stage] = png_ptr->stats_clock_fn(png_ptr);
+}
+
+void /* PRIVATE */
+png_stats_end(png_structrp png_ptr, int stage, png_alloc_size_t count)
+{
+   png_ptr->stats_calls[stage]++;
+   png_ptr->stats_bytes[stage] += count - png_ptr->stats_base[stage];
+
+   /* The difference is taken modulo 2^32 so the clock may wrap. */
+   if (png_ptr->stats_clock_fn != NULL)
+      png_ptr->stats_ticks[stage] += 0xffffffffU &
+          (png_ptr->stats_clock_fn(png_ptr) - png_ptr->stats_start[stage]);
+}
+#endif /* PIPELINE_STATS */
+
 /* Check a user supplied version number, called from both read and write
  * functions that create a png_struct.
  */
@@ -654,6 +688,18 @@ png_free_data(png_const_structrp png_ptr, png_inforp info_ptr, png_uint_32 mask,
       info_ptr->num_palette = 0;
    }
 
+#ifdef PNG_READ_reST_SUPPORTED
+   /* Free the restart points from a reST chunk.  There is no PNG_FREE_ flag
+    * for this private data, so it is only freed along with everything else.
+    */
+   if (mask == PNG_FREE_ALL && num == -1)
+   {
+      png_free(png_ptr, info_ptr->restart_points);
+      info_ptr->restart_points = NULL;
+      info_ptr->num_restart_points = 0;
+   }
+#endif
+
 #ifdef PNG_INFO_IMAGE_SUPPORTED
    /* Free any image bits attached to the info structure */
    if (((mask & PNG_FREE_ROWS) & info_ptr->free_me) != 0)
@@ -3960,6 +4006,53 @@ png_gamma_correct(png_structrp png_ptr, unsigned int value,
 }
 
 #ifdef PNG_16BIT_SUPPORTED
+/* Allocate the 'num' 256 entry subtables of a 16-bit table.  Normally this is
+ * done with a single allocation holding the subtable pointers followed by the
+ * subtables themselves; building a table with all 16 bits significant would
+ * otherwise make 257 calls to the allocator.  Where allocations are limited to
+ * 64K each subtable is allocated separately.
+ */
+static void
+png_alloc_16bit_table(png_structrp png_ptr, png_uint_16pp *ptable,
+    unsigned int num)
+{
+   unsigned int i;
+#ifndef PNG_MAX_MALLOC_64K
+   png_uint_16p sub_table;
+   png_uint_16pp table = *ptable = (png_uint_16pp)png_malloc(png_ptr,
+       num * ((sizeof (png_uint_16p)) + 256 * (sizeof (png_uint_16))));
+
+   sub_table = (png_uint_16p)(table + num);
+
+   for (i = 0; i < num; i++, sub_table += 256)
+      table[i] = sub_table;
+#else
+   png_uint_16pp table = *ptable =
+       (png_uint_16pp)png_calloc(png_ptr, num * (sizeof (png_uint_16p)));
+
+   for (i = 0; i < num; i++)
+      table[i] = (png_uint_16p)png_malloc(png_ptr,
+          256 * (sizeof (png_uint_16)));
+#endif
+}
+
+static void
+png_free_16bit_table(png_structrp png_ptr, png_uint_16pp table)
+{
+#ifdef PNG_MAX_MALLOC_64K
+   if (table != NULL)
+   {
+      int i;
+      int istop = (1 << (8 - png_ptr->gamma_shift));
+
+      for (i = 0; i < istop; i++)
+         png_free(png_ptr, table[i]);
+   }
+#endif
+
+   png_free(png_ptr, table);
+}
+
 /* Internal function to build a single 16-bit table - the table consists of
  * 'num' 256 entry subtables, where 'num' is determined by 'shift' - the amount
  * to shift the input values right (or 16-number_of_signifiant_bits).
@@ -3983,14 +4076,14 @@ png_build_16bit_table(png_structrp png_ptr, png_uint_16pp *ptable,
    unsigned int max = (1U << (16U - shift)) - 1U;
    unsigned int max_by_2 = 1U << (15U - shift);
    unsigned int i;
+   png_uint_16pp table;
 
-   png_uint_16pp table = *ptable =
-       (png_uint_16pp)png_calloc(png_ptr, num * (sizeof (png_uint_16p)));
+   png_alloc_16bit_table(png_ptr, ptable, num);
+   table = *ptable;
 
    for (i = 0; i < num; i++)
    {
-      png_uint_16p sub_table = table[i] =
-          (png_uint_16p)png_malloc(png_ptr, 256 * (sizeof (png_uint_16)));
+      png_uint_16p sub_table = table[i];
 
       /* The 'threshold' test is repeated here because it can arise for one of
        * the 16-bit tables even if the others don't hit it.
@@ -4053,17 +4146,14 @@ png_build_16to8_table(png_structrp png_ptr, png_uint_16pp *ptable,
    unsigned int max = (1U << (16U - shift))-1U;
    unsigned int i;
    png_uint_32 last;
-
-   png_uint_16pp table = *ptable =
-       (png_uint_16pp)png_calloc(png_ptr, num * (sizeof (png_uint_16p)));
+   png_uint_16pp table;
 
    /* 'num' is the number of tables and also the number of low bits of low
     * bits of the input 16-bit value used to select a table.  Each table is
     * itself indexed by the high 8 bits of the value.
     */
-   for (i = 0; i < num; i++)
-      table[i] = (png_uint_16p)png_malloc(png_ptr,
-          256 * (sizeof (png_uint_16)));
+   png_alloc_16bit_table(png_ptr, ptable, num);
+   table = *ptable;
 
    /* 'gamma_val' is set to the reciprocal of the value calculated above, so
     * pow(out,g) is an *input* value.  'last' is the last input value set.
@@ -4130,71 +4220,72 @@ png_build_8bit_table(png_structrp png_ptr, png_bytepp ptable,
 }
 
 /* Used from png_read_destroy and below to release the memory used by the gamma
- * tables.
+ * tables.  png_build_gamma_table shares a table between gamma_table, gamma_to_1
+ * and gamma_from_1 (and the 16-bit equivalents) when they use the same gamma
+ * value, so the shared tables are only freed once.
  */
 void /* PRIVATE */
 png_destroy_gamma_table(png_structrp png_ptr)
 {
-   png_free(png_ptr, png_ptr->gamma_table);
-   png_ptr->gamma_table = NULL;
-
-#ifdef PNG_16BIT_SUPPORTED
-   if (png_ptr->gamma_16_table != NULL)
-   {
-      int i;
-      int istop = (1 << (8 - png_ptr->gamma_shift));
-      for (i = 0; i < istop; i++)
-      {
-         png_free(png_ptr, png_ptr->gamma_16_table[i]);
-      }
-   png_free(png_ptr, png_ptr->gamma_16_table);
-   png_ptr->gamma_16_table = NULL;
-   }
-#endif /* 16BIT */
-
 #if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
    defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
    defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
-   png_free(png_ptr, png_ptr->gamma_from_1);
+   if (png_ptr->gamma_from_1 != png_ptr->gamma_table &&
+       png_ptr->gamma_from_1 != png_ptr->gamma_to_1)
+      png_free(png_ptr, png_ptr->gamma_from_1);
    png_ptr->gamma_from_1 = NULL;
-   png_free(png_ptr, png_ptr->gamma_to_1);
+
+   if (png_ptr->gamma_to_1 != png_ptr->gamma_table)
+      png_free(png_ptr, png_ptr->gamma_to_1);
    png_ptr->gamma_to_1 = NULL;
 
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+   png_free(png_ptr, png_ptr->rgb_to_gray_table);
+   png_ptr->rgb_to_gray_table = NULL;
+#endif
+
 #ifdef PNG_16BIT_SUPPORTED
-   if (png_ptr->gamma_16_from_1 != NULL)
-   {
-      int i;
-      int istop = (1 << (8 - png_ptr->gamma_shift));
-      for (i = 0; i < istop; i++)
-      {
-         png_free(png_ptr, png_ptr->gamma_16_from_1[i]);
-      }
-   png_free(png_ptr, png_ptr->gamma_16_from_1);
+   if (png_ptr->gamma_16_from_1 != png_ptr->gamma_16_table &&
+       png_ptr->gamma_16_from_1 != png_ptr->gamma_16_to_1)
+      png_free_16bit_table(png_ptr, png_ptr->gamma_16_from_1);
    png_ptr->gamma_16_from_1 = NULL;
-   }
-   if (png_ptr->gamma_16_to_1 != NULL)
-   {
-      int i;
-      int istop = (1 << (8 - png_ptr->gamma_shift));
-      for (i = 0; i < istop; i++)
-      {
-         png_free(png_ptr, png_ptr->gamma_16_to_1[i]);
-      }
-   png_free(png_ptr, png_ptr->gamma_16_to_1);
+
+   if (png_ptr->gamma_16_to_1 != png_ptr->gamma_16_table)
+      png_free_16bit_table(png_ptr, png_ptr->gamma_16_to_1);
    png_ptr->gamma_16_to_1 = NULL;
-   }
 #endif /* 16BIT */
 #endif /* READ_BACKGROUND || READ_ALPHA_MODE || RGB_TO_GRAY */
+
+   png_free(png_ptr, png_ptr->gamma_table);
+   png_ptr->gamma_table = NULL;
+
+#ifdef PNG_16BIT_SUPPORTED
+   png_free_16bit_table(png_ptr, png_ptr->gamma_16_table);
+   png_ptr->gamma_16_table = NULL;
+#endif /* 16BIT */
 }
 
 /* We build the 8- or 16-bit gamma tables here.  Note that for 16-bit
  * tables, we don't make a full table if we are reducing to 8-bit in
  * the future.  Note also how the gamma_16 tables are segmented so that
  * we don't need to allocate > 64K chunks for a full 16-bit table.
+ *
+ * The tables are not precomputed, even for the common sRGB cases: they are
+ * power law curves (not the sRGB curve used by png_sRGB_table), their values
+ * depend on whether the fixed or floating point arithmetic is used and their
+ * shape on gamma_shift and PNG_GAMMA_THRESHOLD, so a static copy would give
+ * different results from the table built here.
  */
 void /* PRIVATE */
 png_build_gamma_table(png_structrp png_ptr, int bit_depth)
 {
+   png_fixed_point gamma_val;
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
+   defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
+   png_fixed_point gamma_to_1, gamma_from_1;
+#endif
+
    png_debug(1, "in png_build_gamma_table");
 
    /* Remove any existing table; this copes with multiple calls to
@@ -4209,25 +4300,50 @@ png_build_gamma_table(png_structrp png_ptr, int bit_depth)
       png_destroy_gamma_table(png_ptr);
    }
 
+   /* The gamma values of the three tables: */
+   gamma_val = png_ptr->screen_gamma > 0 ?
+       png_reciprocal2(png_ptr->colorspace.gamma, png_ptr->screen_gamma) :
+       PNG_FP_1;
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
+   defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
+   gamma_to_1 = png_reciprocal(png_ptr->colorspace.gamma);
+   gamma_from_1 = png_ptr->screen_gamma > 0 ?
+       png_reciprocal(png_ptr->screen_gamma) :
+       png_ptr->colorspace.gamma/* Probably doing rgb_to_gray */;
+
+   /* The tables are never modified once built, so where two of them have the
+    * same gamma value they share one copy.  This is common: with a linear
+    * screen (the usual case when compositing) gamma_to_1 is the same as the
+    * main table, and with a linear file so is gamma_from_1.
+    */
+#endif /* READ_BACKGROUND || READ_ALPHA_MODE || RGB_TO_GRAY */
+
    if (bit_depth <= 8)
    {
-      png_build_8bit_table(png_ptr, &png_ptr->gamma_table,
-          png_ptr->screen_gamma > 0 ?
-          png_reciprocal2(png_ptr->colorspace.gamma,
-          png_ptr->screen_gamma) : PNG_FP_1);
+      png_build_8bit_table(png_ptr, &png_ptr->gamma_table, gamma_val);
 
 #if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
    defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
    defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
       if ((png_ptr->transformations & (PNG_COMPOSE | PNG_RGB_TO_GRAY)) != 0)
       {
-         png_build_8bit_table(png_ptr, &png_ptr->gamma_to_1,
-             png_reciprocal(png_ptr->colorspace.gamma));
+         if (gamma_to_1 == gamma_val)
+            png_ptr->gamma_to_1 = png_ptr->gamma_table;
+
+         else
+            png_build_8bit_table(png_ptr, &png_ptr->gamma_to_1, gamma_to_1);
+
+         if (gamma_from_1 == gamma_val)
+            png_ptr->gamma_from_1 = png_ptr->gamma_table;
 
-         png_build_8bit_table(png_ptr, &png_ptr->gamma_from_1,
-             png_ptr->screen_gamma > 0 ?
-             png_reciprocal(png_ptr->screen_gamma) :
-             png_ptr->colorspace.gamma/* Probably doing rgb_to_gray */);
+         else if (gamma_from_1 == gamma_to_1)
+            png_ptr->gamma_from_1 = png_ptr->gamma_to_1;
+
+         else
+            png_build_8bit_table(png_ptr, &png_ptr->gamma_from_1,
+                gamma_from_1);
       }
 #endif /* READ_BACKGROUND || READ_ALPHA_MODE || RGB_TO_GRAY */
    }
@@ -4235,6 +4351,7 @@ png_build_gamma_table(png_structrp png_ptr, int bit_depth)
    else
    {
       png_byte shift, sig_bit;
+      int share = 1;
 
       if ((png_ptr->color_type & PNG_COLOR_MASK_COLOR) != 0)
       {
@@ -4287,6 +4404,16 @@ png_build_gamma_table(png_structrp png_ptr, int bit_depth)
       if (shift > 8U)
          shift = 8U; /* Guarantees at least one table! */
 
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+      /* Under a memory budget give up precision rather than fail; each step
+       * halves the size of the tables of 256 16-bit entries.  There may be
+       * three, and they must leave at least half of the budget for the rest.
+       */
+      while (shift < 8U && png_mem_available(png_ptr) / 6U <
+          ((png_alloc_size_t)512U << (8U - shift)))
+         ++shift;
+#endif
+
       png_ptr->gamma_shift = shift;
 
       /* NOTE: prior to 1.5.4 this test used to include PNG_BACKGROUND (now
@@ -4295,30 +4422,44 @@ png_build_gamma_table(png_structrp png_ptr, int bit_depth)
        * reduced to 8 bits.
        */
       if ((png_ptr->transformations & (PNG_16_TO_8 | PNG_SCALE_16_TO_8)) != 0)
+      {
           png_build_16to8_table(png_ptr, &png_ptr->gamma_16_table, shift,
           png_ptr->screen_gamma > 0 ? png_product2(png_ptr->colorspace.gamma,
           png_ptr->screen_gamma) : PNG_FP_1);
 
+          /* This table has a different format so it can't be shared. */
+          share = 0;
+      }
+
       else
           png_build_16bit_table(png_ptr, &png_ptr->gamma_16_table, shift,
-          png_ptr->screen_gamma > 0 ? png_reciprocal2(png_ptr->colorspace.gamma,
-          png_ptr->screen_gamma) : PNG_FP_1);
+          gamma_val);
 
 #if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
    defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
    defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
       if ((png_ptr->transformations & (PNG_COMPOSE | PNG_RGB_TO_GRAY)) != 0)
       {
-         png_build_16bit_table(png_ptr, &png_ptr->gamma_16_to_1, shift,
-             png_reciprocal(png_ptr->colorspace.gamma));
+         if (share != 0 && gamma_to_1 == gamma_val)
+            png_ptr->gamma_16_to_1 = png_ptr->gamma_16_table;
+
+         else
+            png_build_16bit_table(png_ptr, &png_ptr->gamma_16_to_1, shift,
+                gamma_to_1);
 
          /* Notice that the '16 from 1' table should be full precision, however
           * the lookup on this table still uses gamma_shift, so it can't be.
           * TODO: fix this.
           */
-         png_build_16bit_table(png_ptr, &png_ptr->gamma_16_from_1, shift,
-             png_ptr->screen_gamma > 0 ? png_reciprocal(png_ptr->screen_gamma) :
-             png_ptr->colorspace.gamma/* Probably doing rgb_to_gray */);
+         if (share != 0 && gamma_from_1 == gamma_val)
+            png_ptr->gamma_16_from_1 = png_ptr->gamma_16_table;
+
+         else if (gamma_from_1 == gamma_to_1)
+            png_ptr->gamma_16_from_1 = png_ptr->gamma_16_to_1;
+
+         else
+            png_build_16bit_table(png_ptr, &png_ptr->gamma_16_from_1, shift,
+                gamma_from_1);
       }
 #endif /* READ_BACKGROUND || READ_ALPHA_MODE || RGB_TO_GRAY */
    }
@@ -4547,6 +4688,16 @@ png_image_free_function(png_voidp argument)
       }
 #  endif
 
+#  if PNG_MMAP_READ_OPT > 0
+      if (cp->mapping != NULL)
+      {
+         (void)munmap(cp->mapping, cp->mapping_size);
+         cp->mapping = NULL;
+         cp->png_ptr->read_memory = NULL;
+         cp->png_ptr->read_memory_size = 0;
+      }
+#  endif
+
    /* Copy the control structure so that the original, allocated, version can be
     * safely freed.  Notice that a png_error here stops the remainder of the
     * cleanup, but this is probably fine because that would indicate bad memory
@@ -780,6 +780,14 @@ typedef PNG_CALLBACK(void, *png_read_status_ptr, (png_structp, png_uint_32,
 typedef PNG_CALLBACK(void, *png_write_status_ptr, (png_structp, png_uint_32,
     int));
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* A read function that may return fewer bytes than requested; the return value
+ * is the number of bytes stored in the buffer, 0 means end of input.
+ */
+typedef PNG_CALLBACK(size_t, *png_read_ahead_ptr, (png_structp, png_bytep,
+    size_t));
+#endif
+
 #ifdef PNG_PROGRESSIVE_READ_SUPPORTED
 typedef PNG_CALLBACK(void, *png_progressive_info_ptr, (png_structp, png_infop));
 typedef PNG_CALLBACK(void, *png_progressive_end_ptr, (png_structp, png_infop));
@@ -796,6 +804,22 @@ typedef PNG_CALLBACK(void, *png_progressive_end_ptr, (png_structp, png_infop));
  */
 typedef PNG_CALLBACK(void, *png_progressive_row_ptr, (png_structp, png_bytep,
     png_uint_32, int));
+
+/* The following callback is called with the number of the pass that has just
+ * been completed; see png_set_progressive_frame.
+ */
+typedef PNG_CALLBACK(void, *png_progressive_frame_ptr, (png_structp, int));
+#endif
+
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+typedef PNG_CALLBACK(png_uint_32, *png_stats_clock_ptr, (png_structp));
+#endif
+
+#ifdef PNG_USER_LIMITS_SUPPORTED
+/* Returns non-zero when the decode has run out of time; see
+ * png_set_read_deadline_fn.
+ */
+typedef PNG_CALLBACK(int, *png_read_deadline_ptr, (png_structp));
 #endif
 
 #if defined(PNG_READ_USER_TRANSFORM_SUPPORTED) || \
@@ -1440,6 +1464,18 @@ PNG_EXPORT(66, void, png_set_crc_action, (png_structrp png_ptr, int crit_action,
 #define PNG_CRC_QUIET_USE     4  /* quiet/use data      quiet/use data    */
 #define PNG_CRC_NO_CHANGE     5  /* use current value   use current value */
 
+#ifdef PNG_READ_SUPPORTED
+/* Declare that the data being read was written by libpng and has not been
+ * altered since, for example when it comes from an application's own cache.
+ * When 'trusted' is non-zero libpng does not calculate or check chunk CRCs or
+ * the zlib Adler-32 checksum and does not validate chunk names or lengths.
+ * This overrides png_set_crc_action; corrupt input may give corrupt images.
+ * It is an application error to call this on a write struct.
+ */
+PNG_EXPORT(255, void, png_set_trusted_input, (png_structrp png_ptr,
+    int trusted));
+#endif
+
 #ifdef PNG_WRITE_SUPPORTED
 /* These functions give the user control over the scan-line filtering in
  * libpng and the compression methods used by zlib.  These functions are
@@ -1522,6 +1558,23 @@ PNG_EXPORT(72, void, png_set_compression_window_bits, (png_structrp png_ptr,
 
 PNG_EXPORT(73, void, png_set_compression_method, (png_structrp png_ptr,
     int method));
+
+/* Select the filters and IDAT zlib settings together.  The preset is applied
+ * when the first row is written and replaces the values set by
+ * png_set_filter and the png_set_compression_ functions above.
+ * PNG_COMPRESSION_AUTO examines a sample of the rows to choose settings suited
+ * to synthetic images (screenshots, text, line art) or to photographs.  The
+ * sample is taken from the rows passed to the first png_write_image or
+ * png_write_rows call; png_write_row alone only provides the first row, which
+ * is rarely representative, so AUTO is best used with one of the others.
+ */
+#define PNG_COMPRESSION_DEFAULT  0 /* use the individual settings */
+#define PNG_COMPRESSION_FASTEST  1
+#define PNG_COMPRESSION_BALANCED 2
+#define PNG_COMPRESSION_SMALLEST 3
+#define PNG_COMPRESSION_AUTO     4
+PNG_EXPORT(263, void, png_set_compression_preset, (png_structrp png_ptr,
+    int preset));
 #endif /* WRITE_CUSTOMIZE_COMPRESSION */
 
 #ifdef PNG_WRITE_CUSTOMIZE_ZTXT_COMPRESSION_SUPPORTED
@@ -1591,6 +1644,34 @@ PNG_EXPORT(77, void, png_set_write_fn, (png_structrp png_ptr, png_voidp io_ptr,
 PNG_EXPORT(78, void, png_set_read_fn, (png_structrp png_ptr, png_voidp io_ptr,
     png_rw_ptr read_data_fn));
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* Replace the data input function with one that is asked for large blocks of
+ * input of up to buffer_size bytes and may return as many bytes as are
+ * currently available.  libpng satisfies its own (often very small) reads
+ * from the buffered data.  buffer_size 0 selects a default size.
+ */
+PNG_EXPORT(250, void, png_set_read_ahead_fn, (png_structrp png_ptr,
+    png_voidp io_ptr, png_read_ahead_ptr read_ahead_fn, size_t buffer_size));
+#endif
+
+#ifdef PNG_WRITE_SUPPORTED
+/* Collect output in a buffer of buffer_size bytes and pass it to the write
+ * function in blocks of that size; pending data is written by png_write_flush
+ * and png_write_end.  buffer_size 0 turns buffering off (the default.)
+ */
+PNG_EXPORT(251, void, png_set_write_buffer_size, (png_structrp png_ptr,
+    size_t buffer_size));
+
+/* Write IDAT chunks of 'size' bytes (except the last) rather than one for each
+ * compression buffer.  Sizes above the compression buffer size are rounded
+ * down to a multiple of it, PNG_UINT_31_MAX gives a single IDAT chunk and 0
+ * restores the default.  The compressed data of a chunk is held in memory
+ * until the chunk is complete.
+ */
+PNG_EXPORT(262, void, png_set_IDAT_chunk_size, (png_structrp png_ptr,
+    png_uint_32 size));
+#endif
+
 /* Return the user pointer associated with the I/O functions */
 PNG_EXPORT(79, png_voidp, png_get_io_ptr, (png_const_structrp png_ptr));
 
@@ -1683,6 +1764,23 @@ PNG_EXPORT(90, void, png_set_progressive_read_fn, (png_structrp png_ptr,
 PNG_EXPORT(91, png_voidp, png_get_progressive_ptr,
     (png_const_structrp png_ptr));
 
+/* Give the push reader the rows of a frame buffer (one for each row of the
+ * image, each big enough for png_get_rowbytes after png_read_update_info).
+ * libpng combines each new row into the frame buffer itself.  For interlaced
+ * images 'display' selects how: PNG_FRAME_RECTANGLE replicates each pixel over
+ * the block of the image it stands for, as the 'blocky' display of
+ * png_progressive_combine_row does, so the frame buffer holds a complete,
+ * increasingly detailed, preview after each pass; PNG_FRAME_SPARKLE only sets
+ * the pixels of each pass, leaving the others unchanged.  If frame_fn is not
+ * NULL it is called as each pass completes; for a non-interlaced image it is
+ * called once, with pass 0.  Interlaced images are only combined if
+ * png_set_interlace_handling has been called.
+ */
+#define PNG_FRAME_SPARKLE   0
+#define PNG_FRAME_RECTANGLE 1
+PNG_EXPORT(252, void, png_set_progressive_frame, (png_structrp png_ptr,
+    png_bytepp rows, int display, png_progressive_frame_ptr frame_fn));
+
 /* Function to be called when data becomes available */
 PNG_EXPORT(92, void, png_process_data, (png_structrp png_ptr,
     png_inforp info_ptr, png_bytep buffer, size_t buffer_size));
@@ -1990,6 +2088,17 @@ PNG_EXPORT(249, void, png_set_eXIf_1, (png_const_structrp png_ptr,
     png_inforp info_ptr, png_uint_32 num_exif, png_bytep exif));
 #endif
 
+#ifdef PNG_READ_reST_SUPPORTED
+/* Return the number of restart points recorded in a reST chunk by a writer
+ * using the PNG_FLUSH_RESTART option and set *points to an array of that many
+ * (row, offset) pairs.  The chunk follows the image data, so it is only seen
+ * by png_read_end (or the progressive reader's end callback.)
+ */
+PNG_EXPORT(264, png_uint_32, png_get_restart_points,
+    (png_const_structrp png_ptr, png_const_inforp info_ptr,
+    png_const_uint_32p *points));
+#endif
+
 #ifdef PNG_gAMA_SUPPORTED
 PNG_FP_EXPORT(137, png_uint_32, png_get_gAMA, (png_const_structrp png_ptr,
     png_const_inforp info_ptr, double *file_gamma))
@@ -2374,6 +2483,36 @@ PNG_EXPORT(191, void, png_set_chunk_malloc_max, (png_structrp png_ptr,
     png_alloc_size_t user_chunk_cache_max));
 PNG_EXPORT(192, png_alloc_size_t, png_get_chunk_malloc_max,
     (png_const_structrp png_ptr));
+
+/* Decompression budgets for untrusted input, 0 means unlimited.  Each one
+ * stops the read with its own error message as soon as it is exceeded.
+ * ratio_max limits the decompressed size to that multiple of the compressed
+ * size, size_max limits the decompressed size of one chunk type ("zTXt",
+ * "iTXt", "iCCP" or "IDAT", the last for the whole image) and chunk_count_max
+ * the total number of chunks.  The deadline function is called after every
+ * 'rows' rows are decompressed and stops the read if it returns non-zero.
+ */
+PNG_EXPORT(258, void, png_set_inflate_ratio_max, (png_structrp png_ptr,
+    png_uint_32 ratio_max));
+PNG_EXPORT(259, void, png_set_inflate_size_max, (png_structrp png_ptr,
+    png_const_bytep chunk_name, png_alloc_size_t size_max));
+PNG_EXPORT(260, void, png_set_chunk_count_max, (png_structrp png_ptr,
+    png_uint_32 chunk_count_max));
+PNG_EXPORT(261, void, png_set_read_deadline_fn, (png_structrp png_ptr,
+    png_read_deadline_ptr deadline_fn, png_uint_32 rows));
+#endif
+
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+/* Limit the total memory allocated through the png_struct, including by zlib,
+ * to 'budget' bytes (0 means unlimited).  When the budget is short the reader
+ * skips ancillary chunks, reads IDAT in smaller pieces and uses less precise
+ * 16-bit gamma tables rather than failing.  png_get_memory_usage returns the
+ * bytes currently allocated and the peak; either pointer may be NULL.
+ */
+PNG_EXPORT(256, void, png_set_memory_budget, (png_structrp png_ptr,
+    png_alloc_size_t budget));
+PNG_EXPORT(257, void, png_get_memory_usage, (png_const_structrp png_ptr,
+    png_alloc_size_t *live, png_alloc_size_t *peak));
 #endif
 
 #if defined(PNG_INCH_CONVERSIONS_SUPPORTED)
@@ -2430,6 +2569,34 @@ PNG_EXPORT(216, png_uint_32, png_get_io_chunk_type,
 #  define PNG_IO_MASK_LOC    0x00f0   /* current location: sig/hdr/data/crc */
 #endif /* IO_STATE */
 
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+/* Profiling counters, only present if libpng was built with the (normally
+ * disabled) PIPELINE_STATS option.  For each stage below libpng counts the
+ * calls and the bytes processed and, if a clock function has been set, adds up
+ * the ticks it reports across each call.  The clock may count in any unit (for
+ * example nanoseconds or cycles) and may wrap, but a single call to a stage
+ * must take less than 2^32 ticks.
+ *
+ * png_set_pipeline_stats_clock sets the clock function (which may be NULL) and
+ * resets all the counters.  png_get_pipeline_stats returns the counters of one
+ * stage through any of the pointers that are not NULL; it returns 0 if the
+ * stage number is not valid, otherwise 1.
+ */
+#define PNG_STAGE_IO        0 /* read or write callback: bytes transferred */
+#define PNG_STAGE_CRC       1 /* chunk CRC: bytes checked */
+#define PNG_STAGE_ZLIB      2 /* image inflate or deflate: bytes uncompressed */
+#define PNG_STAGE_FILTER    3 /* unfiltering or filter selection: row bytes */
+#define PNG_STAGE_TRANSFORM 4 /* row transformations: row bytes */
+#define PNG_STAGE_COMBINE   5 /* storing rows in the application buffers */
+#define PNG_STAGE_COUNT     6
+
+PNG_EXPORT(253, void, png_set_pipeline_stats_clock, (png_structrp png_ptr,
+    png_stats_clock_ptr clock_fn));
+PNG_EXPORT(254, int, png_get_pipeline_stats, (png_const_structrp png_ptr,
+    int stage, png_uint_32p calls, png_alloc_size_t *bytes,
+    png_alloc_size_t *ticks));
+#endif /* PIPELINE_STATS */
+
 /* Interlace support.  The following macros are always defined so that if
  * libpng interlace handling is turned off the macros may be used to handle
  * interlaced images within the application.
@@ -3211,7 +3378,9 @@ PNG_EXPORT(245, int, png_image_write_to_memory, (png_imagep image, void *memory,
 #ifdef PNG_POWERPC_VSX_API_SUPPORTED
 #  define PNG_POWERPC_VSX   10 /* HARDWARE: PowerPC VSX SIMD instructions supported */
 #endif
-#define PNG_OPTION_NEXT  12 /* Next option - numbers must be even */
+#define PNG_FLUSH_RESTART 12 /* SOFTWARE: make each flush a restart point */
+#define PNG_ADAPTIVE_IDAT_READ 14 /* SOFTWARE: read whole IDAT chunks */
+#define PNG_OPTION_NEXT  16 /* Next option - numbers must be even */
 
 /* Return values: NOTE: there are four values and 'off' is *not* zero */
 #define PNG_OPTION_UNSET   0 /* Unset - defaults to off */
@@ -3235,7 +3404,7 @@ PNG_EXPORT(244, int, png_set_option, (png_structrp png_ptr, int option,
  * one to use is one more than this.)
  */
 #ifdef PNG_EXPORT_LAST_ORDINAL
-  PNG_EXPORT_LAST_ORDINAL(249);
+  PNG_EXPORT_LAST_ORDINAL(264);
 #endif
 
 #ifdef __cplusplus
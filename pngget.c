@@ -803,6 +803,24 @@ png_get_eXIf_1(png_const_structrp png_ptr, png_const_inforp info_ptr,
 }
 #endif
 
+#ifdef PNG_READ_reST_SUPPORTED
+png_uint_32 PNGAPI
+png_get_restart_points(png_const_structrp png_ptr, png_const_inforp info_ptr,
+    png_const_uint_32p *points)
+{
+   png_debug1(1, "in %s retrieval function", "reST");
+
+   if (png_ptr != NULL && info_ptr != NULL && points != NULL &&
+       info_ptr->restart_points != NULL)
+   {
+      *points = info_ptr->restart_points;
+      return info_ptr->num_restart_points;
+   }
+
+   return (0);
+}
+#endif
+
 #ifdef PNG_hIST_SUPPORTED
 png_uint_32 PNGAPI
 png_get_hIST(png_const_structrp png_ptr, png_inforp info_ptr,
@@ -1218,6 +1236,19 @@ png_get_chunk_malloc_max(png_const_structrp png_ptr)
 }
 #endif /* SET_USER_LIMITS */
 
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+void PNGAPI
+png_get_memory_usage(png_const_structrp png_ptr, png_alloc_size_t *live,
+    png_alloc_size_t *peak)
+{
+   if (live != NULL)
+      *live = png_ptr != NULL ? png_ptr->mem_live : 0;
+
+   if (peak != NULL)
+      *peak = png_ptr != NULL ? png_ptr->mem_peak : 0;
+}
+#endif /* MEMORY_BUDGET */
+
 /* These functions were added to libpng 1.4.0 */
 #ifdef PNG_IO_STATE_SUPPORTED
 png_uint_32 PNGAPI
@@ -1233,6 +1264,27 @@ png_get_io_chunk_type(png_const_structrp png_ptr)
 }
 #endif /* IO_STATE */
 
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+int PNGAPI
+png_get_pipeline_stats(png_const_structrp png_ptr, int stage,
+    png_uint_32p calls, png_alloc_size_t *bytes, png_alloc_size_t *ticks)
+{
+   if (png_ptr == NULL || stage < 0 || stage >= PNG_STAGE_COUNT)
+      return 0;
+
+   if (calls != NULL)
+      *calls = png_ptr->stats_calls[stage];
+
+   if (bytes != NULL)
+      *bytes = png_ptr->stats_bytes[stage];
+
+   if (ticks != NULL)
+      *ticks = png_ptr->stats_ticks[stage];
+
+   return 1;
+}
+#endif /* PIPELINE_STATS */
+
 #ifdef PNG_CHECK_FOR_INVALID_INDEX_SUPPORTED
 #  ifdef PNG_GET_PALETTE_MAX_SUPPORTED
 int PNGAPI
@@ -263,5 +263,14 @@ defined(PNG_READ_BACKGROUND_SUPPORTED)
    png_bytepp row_pointers;        /* the image bits */
 #endif
 
+#ifdef PNG_READ_reST_SUPPORTED
+   /* The row, offset pairs from a private reST chunk, which records the
+    * restart points of an image written with the PNG_FLUSH_RESTART option.
+    * See png_get_restart_points.  Added at libpng-1.6.38.
+    */
+   png_uint_32p restart_points;
+   png_uint_32 num_restart_points;
+#endif
+
 };
 #endif /* PNGINFO_H */
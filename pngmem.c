@@ -59,6 +59,31 @@ png_calloc,(png_const_structrp png_ptr, png_alloc_size_t size),PNG_ALLOCATED)
    return ret;
 }
 
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+/* Each allocation made through a png_struct is preceded by its size so that
+ * png_free can account for it.  The union keeps the memory returned to the
+ * caller as well aligned as the memory from malloc.
+ */
+typedef union
+{
+   png_alloc_size_t size;
+   long double      align_ld;
+   png_voidp        align_p;
+}  png_mem_header;
+
+png_alloc_size_t /* PRIVATE */
+png_mem_available(png_const_structrp png_ptr)
+{
+   if (png_ptr->mem_budget == 0)
+      return PNG_SIZE_MAX;
+
+   if (png_ptr->mem_live >= png_ptr->mem_budget)
+      return 0;
+
+   return png_ptr->mem_budget - png_ptr->mem_live;
+}
+#endif /* MEMORY_BUDGET */
+
 /* png_malloc_base, an internal function added at libpng 1.6.0, does the work of
  * allocating memory, taking into account limits and PNG_USER_MEM_SUPPORTED.
  * Checking and error handling must happen outside this routine; it returns NULL
@@ -86,6 +111,43 @@ png_malloc_base,(png_const_structrp png_ptr, png_alloc_size_t size),
 #     endif
       )
    {
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+      /* An application memory function must use png_malloc_default, which
+       * passes a NULL png_ptr, so it does not reach this code.
+       */
+      if (png_ptr != NULL)
+      {
+         png_structrp pp = png_constcast(png_structrp,png_ptr);
+         png_mem_header *header;
+
+         if (size > png_mem_available(png_ptr) ||
+             size > PNG_SIZE_MAX - (sizeof *header))
+            return NULL;
+
+         size += (sizeof *header);
+
+#        ifdef PNG_USER_MEM_SUPPORTED
+         if (png_ptr->malloc_fn != NULL)
+            header = png_voidcast(png_mem_header*, png_ptr->malloc_fn(pp,
+                size));
+
+         else
+#        endif
+            header = png_voidcast(png_mem_header*, malloc((size_t)size));
+
+         if (header == NULL)
+            return NULL;
+
+         header->size = size - (sizeof *header);
+         pp->mem_live += header->size;
+
+         if (pp->mem_live > pp->mem_peak)
+            pp->mem_peak = pp->mem_live;
+
+         return header + 1;
+      }
+#endif /* MEMORY_BUDGET */
+
 #ifdef PNG_USER_MEM_SUPPORTED
       if (png_ptr != NULL && png_ptr->malloc_fn != NULL)
          return png_ptr->malloc_fn(png_constcast(png_structrp,png_ptr), size);
@@ -234,6 +296,20 @@ png_free(png_const_structrp png_ptr, png_voidp ptr)
    if (png_ptr == NULL || ptr == NULL)
       return;
 
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+   /* Every block allocated through png_ptr has a header; the application's
+    * free_fn, like png_free_default, is passed the start of the block.
+    */
+   {
+      png_structrp pp = png_constcast(png_structrp,png_ptr);
+      png_mem_header *header = png_voidcast(png_mem_header*, ptr);
+
+      --header;
+      pp->mem_live -= header->size;
+      ptr = header;
+   }
+#endif
+
 #ifdef PNG_USER_MEM_SUPPORTED
    if (png_ptr->free_fn != NULL)
       png_ptr->free_fn(png_constcast(png_structrp,png_ptr), ptr);
@@ -190,6 +190,12 @@ png_push_read_chunk(png_structrp png_ptr, png_inforp info_ptr)
       png_ptr->chunk_name = PNG_CHUNK_FROM_STRING(chunk_tag);
       png_check_chunk_name(png_ptr, png_ptr->chunk_name);
       png_check_chunk_length(png_ptr, png_ptr->push_length);
+#ifdef PNG_USER_LIMITS_SUPPORTED
+      png_check_chunk_count(png_ptr);
+#endif
+#ifdef PNG_READ_reST_SUPPORTED
+      png_count_IDAT(png_ptr, png_ptr->push_length);
+#endif
       png_ptr->mode |= PNG_HAVE_CHUNK_HEADER;
    }
 
@@ -350,6 +356,14 @@ png_push_read_chunk(png_structrp png_ptr, png_inforp info_ptr)
       png_handle_pHYs(png_ptr, info_ptr, png_ptr->push_length);
    }
 
+#endif
+#ifdef PNG_READ_reST_SUPPORTED
+   else if (chunk_name == png_reST)
+   {
+      PNG_PUSH_SAVE_BUFFER_IF_FULL
+      png_handle_reST(png_ptr, info_ptr, png_ptr->push_length);
+   }
+
 #endif
 #ifdef PNG_READ_oFFs_SUPPORTED
    else if (chunk_name == png_oFFs)
@@ -546,6 +560,12 @@ png_push_read_IDAT(png_structrp png_ptr)
       png_crc_read(png_ptr, chunk_tag, 4);
       png_ptr->chunk_name = PNG_CHUNK_FROM_STRING(chunk_tag);
       png_ptr->mode |= PNG_HAVE_CHUNK_HEADER;
+#ifdef PNG_USER_LIMITS_SUPPORTED
+      png_check_chunk_count(png_ptr);
+#endif
+#ifdef PNG_READ_reST_SUPPORTED
+      png_count_IDAT(png_ptr, png_ptr->push_length);
+#endif
 
       if (png_ptr->chunk_name != png_IDAT)
       {
@@ -668,7 +688,13 @@ png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
        * change the current behavior (see comments in inflate.c
        * for why this doesn't happen at present with zlib 1.2.5).
        */
+      png_stats_begin(png_ptr, PNG_STAGE_ZLIB, png_ptr->zstream.total_out);
       ret = PNG_INFLATE(png_ptr, Z_SYNC_FLUSH);
+      png_stats_end(png_ptr, PNG_STAGE_ZLIB, png_ptr->zstream.total_out);
+
+#ifdef PNG_USER_LIMITS_SUPPORTED
+      png_check_inflate_limits(png_ptr);
+#endif
 
       /* Check for any failure before proceeding. */
       if (ret != Z_OK && ret != Z_STREAM_END)
@@ -719,7 +745,12 @@ png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
 
          /* Do we have a complete row? */
          if (png_ptr->zstream.avail_out == 0)
+         {
+#ifdef PNG_USER_LIMITS_SUPPORTED
+            png_check_read_deadline(png_ptr);
+#endif
             png_push_process_row(png_ptr);
+         }
       }
 
       /* And check for the end of the stream. */
@@ -751,8 +782,13 @@ png_push_process_row(png_structrp png_ptr)
    if (png_ptr->row_buf[0] > PNG_FILTER_VALUE_NONE)
    {
       if (png_ptr->row_buf[0] < PNG_FILTER_VALUE_LAST)
+      {
+         png_stats_begin(png_ptr, PNG_STAGE_FILTER, 0);
          png_read_filter_row(png_ptr, &row_info, png_ptr->row_buf + 1,
             png_ptr->prev_row + 1, png_ptr->row_buf[0]);
+         png_stats_end(png_ptr, PNG_STAGE_FILTER, row_info.rowbytes);
+      }
+
       else
          png_error(png_ptr, "bad adaptive filter value");
    }
@@ -760,13 +796,20 @@ png_push_process_row(png_structrp png_ptr)
    /* libpng 1.5.6: the following line was copying png_ptr->rowbytes before
     * 1.5.6, while the buffer really is this big in current versions of libpng
     * it may not be in the future, so this was changed just to copy the
-    * interlaced row count:
+    * interlaced row count.  As in png_read_row the copy is avoided, by
+    * swapping the buffers after the row has been passed to the application,
+    * if no transformations are going to modify the row.
     */
-   memcpy(png_ptr->prev_row, png_ptr->row_buf, row_info.rowbytes + 1);
+   if (png_ptr->transformations != 0)
+      memcpy(png_ptr->prev_row, png_ptr->row_buf, row_info.rowbytes + 1);
 
 #ifdef PNG_READ_TRANSFORMS_SUPPORTED
    if (png_ptr->transformations != 0)
+   {
+      png_stats_begin(png_ptr, PNG_STAGE_TRANSFORM, 0);
       png_do_read_transformations(png_ptr, &row_info);
+      png_stats_end(png_ptr, PNG_STAGE_TRANSFORM, row_info.rowbytes);
+   }
 #endif
 
    /* The transformed pixel depth should match the depth now in row_info. */
@@ -961,6 +1004,15 @@ png_push_process_row(png_structrp png_ptr)
 #endif
    {
       png_push_have_row(png_ptr, png_ptr->row_buf + 1);
+
+      if (png_ptr->transformations == 0)
+      {
+         png_bytep prev_row = png_ptr->prev_row;
+
+         png_ptr->prev_row = png_ptr->row_buf;
+         png_ptr->row_buf = prev_row;
+      }
+
       png_read_push_finish_row(png_ptr);
    }
 }
@@ -993,6 +1045,9 @@ png_read_push_finish_row(png_structrp png_ptr)
    if (png_ptr->row_number < png_ptr->num_rows)
       return;
 
+   if (png_ptr->frame_fn != NULL)
+      (*(png_ptr->frame_fn))(png_ptr, (int)png_ptr->pass);
+
 #ifdef PNG_READ_INTERLACING_SUPPORTED
    if (png_ptr->interlaced != 0)
    {
@@ -1048,6 +1103,28 @@ png_push_have_end(png_structrp png_ptr, png_inforp info_ptr)
 void /* PRIVATE */
 png_push_have_row(png_structrp png_ptr, png_bytep row)
 {
+   /* Combine the row into the frame buffer first, so that it is up to date
+    * when the application callback is called.  Without libpng interlace
+    * handling the rows are the rows of each pass, which can't be combined.
+    */
+   if (row != NULL && png_ptr->frame_rows != NULL &&
+       (png_ptr->interlaced == 0 ||
+       (png_ptr->transformations & PNG_INTERLACE) != 0))
+   {
+      /* The row of an early pass is passed for every image row of its block;
+       * the sparkle display only stores it in the row it came from.
+       */
+      if (png_ptr->frame_display == PNG_FRAME_RECTANGLE ||
+          png_ptr->interlaced == 0 ||
+          PNG_ROW_IN_INTERLACE_PASS(png_ptr->row_number, png_ptr->pass) != 0)
+      {
+         png_stats_begin(png_ptr, PNG_STAGE_COMBINE, 0);
+         png_combine_row(png_ptr, png_ptr->frame_rows[png_ptr->row_number],
+             png_ptr->frame_display == PNG_FRAME_RECTANGLE);
+         png_stats_end(png_ptr, PNG_STAGE_COMBINE, png_ptr->info_rowbytes);
+      }
+   }
+
    if (png_ptr->row_fn != NULL)
       (*(png_ptr->row_fn))(png_ptr, row, png_ptr->row_number,
           (int)png_ptr->pass);
@@ -1070,6 +1147,24 @@ png_progressive_combine_row(png_const_structrp png_ptr, png_bytep old_row,
 }
 #endif /* READ_INTERLACING */
 
+void PNGAPI
+png_set_progressive_frame(png_structrp png_ptr, png_bytepp rows, int display,
+    png_progressive_frame_ptr frame_fn)
+{
+   if (png_ptr == NULL)
+      return;
+
+   if (display != PNG_FRAME_SPARKLE && display != PNG_FRAME_RECTANGLE)
+   {
+      png_app_error(png_ptr, "png_set_progressive_frame: invalid display");
+      return;
+   }
+
+   png_ptr->frame_rows = rows;
+   png_ptr->frame_display = display;
+   png_ptr->frame_fn = frame_fn;
+}
+
 void PNGAPI
 png_set_progressive_read_fn(png_structrp png_ptr, png_voidp progressive_ptr,
     png_progressive_info_ptr info_fn, png_progressive_row_ptr row_fn,
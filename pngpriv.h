@@ -270,6 +270,28 @@
 #  define PNG_POWERPC_VSX_IMPLEMENTATION 1
 #endif
 
+/* Memory mapped input for png_image_begin_read_from_file.  The file is mapped
+ * read-only and read with the same code as png_image_begin_read_from_memory,
+ * bypassing the stdio buffer.  This is only implemented for Linux at present.
+ * PNG_MMAP_READ_OPT may be set in CPPFLAGS to:
+ *
+ *    0  Do not use mmap; always read the file through stdio (the default)
+ *    1  Map the file
+ *    2  Map the file and pre-fault the whole mapping (MAP_POPULATE)
+ *
+ * It is off by default because a mapped file that is truncated while it is
+ * being read raises SIGBUS, which kills the process, where stdio would give a
+ * png_image error.
+ */
+#ifndef PNG_MMAP_READ_OPT
+#  define PNG_MMAP_READ_OPT 0
+#endif
+#if PNG_MMAP_READ_OPT > 0 && !(defined(__linux__) && \
+   defined(PNG_SIMPLIFIED_READ_SUPPORTED) && defined(PNG_STDIO_SUPPORTED))
+#  undef PNG_MMAP_READ_OPT
+#  define PNG_MMAP_READ_OPT 0
+#endif
+
 
 /* Is this a build of a DLL where compilation of the object modules requires
  * different preprocessor settings to those required for a simple library?  If
@@ -678,9 +700,9 @@
 /* Flags for the png_ptr->flags rather than declaring a byte for each one */
 #define PNG_FLAG_ZLIB_CUSTOM_STRATEGY     0x0001U
 #define PNG_FLAG_ZSTREAM_INITIALIZED      0x0002U /* Added to libpng-1.6.0 */
-                                  /*      0x0004U    unused */
+#define PNG_FLAG_RESTART_ROW              0x0004U /* Added to libpng-1.6.38 */
 #define PNG_FLAG_ZSTREAM_ENDED            0x0008U /* Added to libpng-1.6.0 */
-                                  /*      0x0010U    unused */
+#define PNG_FLAG_TRUSTED_INPUT            0x0010U /* Added to libpng-1.6.38 */
                                   /*      0x0020U    unused */
 #define PNG_FLAG_ROW_INIT                 0x0040U
 #define PNG_FLAG_FILLER_AFTER             0x0080U
@@ -863,6 +885,7 @@
 #define png_oFFs PNG_U32(111,  70,  70, 115)
 #define png_pCAL PNG_U32(112,  67,  65,  76)
 #define png_pHYs PNG_U32(112,  72,  89, 115)
+#define png_reST PNG_U32(114, 101,  83,  84) /* private, see png_handle_reST */
 #define png_sBIT PNG_U32(115,  66,  73,  84)
 #define png_sCAL PNG_U32(115,  67,  65,  76)
 #define png_sPLT PNG_U32(115,  80,  76,  84)
@@ -1079,6 +1102,10 @@ PNG_INTERNAL_FUNCTION(void,png_reset_crc,(png_structrp png_ptr),PNG_EMPTY);
 PNG_INTERNAL_FUNCTION(void,png_write_data,(png_structrp png_ptr,
     png_const_bytep data, size_t length),PNG_EMPTY);
 
+/* Pass any output held by png_set_write_buffer_size to the write function */
+PNG_INTERNAL_FUNCTION(void,png_write_buffered_data,(png_structrp png_ptr),
+    PNG_EMPTY);
+
 /* Read and check the PNG file signature */
 PNG_INTERNAL_FUNCTION(void,png_read_sig,(png_structrp png_ptr,
    png_inforp info_ptr),PNG_EMPTY);
@@ -1087,10 +1114,47 @@ PNG_INTERNAL_FUNCTION(void,png_read_sig,(png_structrp png_ptr,
 PNG_INTERNAL_FUNCTION(png_uint_32,png_read_chunk_header,(png_structrp png_ptr),
    PNG_EMPTY);
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* Default buffer size for png_set_read_ahead_fn */
+#  ifndef PNG_READ_AHEAD_SIZE
+#     define PNG_READ_AHEAD_SIZE 32768
+#  endif
+#endif
+
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+/* The part of the memory budget not yet allocated, PNG_SIZE_MAX if there is no
+ * budget.
+ */
+PNG_INTERNAL_FUNCTION(png_alloc_size_t,png_mem_available,
+   (png_const_structrp png_ptr),PNG_EMPTY);
+#endif
+
 /* Read data from whatever input you are using into the "data" buffer */
 PNG_INTERNAL_FUNCTION(void,png_read_data,(png_structrp png_ptr, png_bytep data,
     size_t length),PNG_EMPTY);
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* Read from size bytes at memory; the memory must remain valid until reading
+ * is finished.
+ */
+PNG_INTERNAL_FUNCTION(void,png_set_read_memory,(png_structrp png_ptr,
+    png_const_bytep memory, size_t size),PNG_EMPTY);
+
+/* Called after each chunk header is read to limit read-ahead to the rest of
+ * the chunk and the header of the next one.
+ */
+PNG_INTERNAL_FUNCTION(void,png_read_ahead_chunk,(png_structrp png_ptr,
+    png_uint_32 length),PNG_EMPTY);
+
+/* Consume up to *length bytes of input without copying them.  Returns a
+ * pointer to the data and sets *length to the number of bytes available, or
+ * returns NULL if the input is not already in memory.  The pointer is only
+ * valid until the next read.
+ */
+PNG_INTERNAL_FUNCTION(png_const_bytep,png_read_data_direct,
+    (png_structrp png_ptr, size_t *length),PNG_EMPTY);
+#endif
+
 /* Read bytes into buf, and update png_ptr->crc */
 PNG_INTERNAL_FUNCTION(void,png_crc_read,(png_structrp png_ptr, png_bytep buf,
     png_uint_32 length),PNG_EMPTY);
@@ -1109,6 +1173,21 @@ PNG_INTERNAL_FUNCTION(int,png_crc_error,(png_structrp png_ptr),PNG_EMPTY);
 PNG_INTERNAL_FUNCTION(void,png_calculate_crc,(png_structrp png_ptr,
    png_const_bytep ptr, size_t length),PNG_EMPTY);
 
+/* Profiling of the PNG_STAGE_ stages.  png_stats_end adds (count - base) to
+ * the bytes of the stage, so 'base' and 'count' may be the running totals of
+ * a zlib stream or simply 0 and the number of bytes.  Without PIPELINE_STATS
+ * the macros expand to nothing and their arguments are not evaluated.
+ */
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+PNG_INTERNAL_FUNCTION(void,png_stats_begin,(png_structrp png_ptr, int stage,
+   png_alloc_size_t base),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_stats_end,(png_structrp png_ptr, int stage,
+   png_alloc_size_t count),PNG_EMPTY);
+#else
+#  define png_stats_begin(pp, stage, base) ((void)0)
+#  define png_stats_end(pp, stage, count) ((void)0)
+#endif
+
 #ifdef PNG_WRITE_FLUSH_SUPPORTED
 PNG_INTERNAL_FUNCTION(void,png_flush,(png_structrp png_ptr),PNG_EMPTY);
 #endif
@@ -1157,6 +1236,11 @@ PNG_INTERNAL_FUNCTION(void,png_write_eXIf,(png_structrp png_ptr,
     png_bytep exif, int num_exif),PNG_EMPTY);
 #endif
 
+#ifdef PNG_WRITE_reST_SUPPORTED
+PNG_INTERNAL_FUNCTION(void,png_write_reST,(png_structrp png_ptr,
+    png_const_uint_32p points, png_uint_32 num_points),PNG_EMPTY);
+#endif
+
 #ifdef PNG_WRITE_iCCP_SUPPORTED
 PNG_INTERNAL_FUNCTION(void,png_write_iCCP,(png_structrp png_ptr,
    png_const_charp name, png_const_bytep profile), PNG_EMPTY);
@@ -1289,7 +1373,7 @@ PNG_INTERNAL_FUNCTION(void,png_do_read_interlace,(png_row_infop row_info,
 #ifdef PNG_WRITE_INTERLACING_SUPPORTED
 /* Grab pixels out of a row for an interlaced pass */
 PNG_INTERNAL_FUNCTION(void,png_do_write_interlace,(png_row_infop row_info,
-    png_bytep row, int pass),PNG_EMPTY);
+    png_const_bytep src, png_bytep row, int pass),PNG_EMPTY);
 #endif
 
 /* Unfilter a row: check the filter value before calling this, there is no point
@@ -1461,6 +1545,14 @@ PNG_INTERNAL_FUNCTION(void,png_handle_eXIf,(png_structrp png_ptr,
     png_inforp info_ptr, png_uint_32 length),PNG_EMPTY);
 #endif
 
+#ifdef PNG_READ_reST_SUPPORTED
+PNG_INTERNAL_FUNCTION(void,png_handle_reST,(png_structrp png_ptr,
+    png_inforp info_ptr, png_uint_32 length),PNG_EMPTY);
+/* Add an IDAT chunk's length to the total used to check reST offsets. */
+PNG_INTERNAL_FUNCTION(void,png_count_IDAT,(png_structrp png_ptr,
+    png_uint_32 length),PNG_EMPTY);
+#endif
+
 #ifdef PNG_READ_gAMA_SUPPORTED
 PNG_INTERNAL_FUNCTION(void,png_handle_gAMA,(png_structrp png_ptr,
     png_inforp info_ptr, png_uint_32 length),PNG_EMPTY);
@@ -1542,6 +1634,18 @@ PNG_INTERNAL_FUNCTION(void,png_check_chunk_name,(png_const_structrp png_ptr,
 PNG_INTERNAL_FUNCTION(void,png_check_chunk_length,(png_const_structrp png_ptr,
     png_uint_32 chunk_length),PNG_EMPTY);
 
+#ifdef PNG_USER_LIMITS_SUPPORTED
+/* Enforce the application decompression budgets; each of these calls
+ * png_chunk_error (or png_error for the deadline) when a budget is exceeded.
+ */
+PNG_INTERNAL_FUNCTION(void,png_check_chunk_count,(png_structrp png_ptr),
+    PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_check_inflate_limits,(png_structrp png_ptr),
+    PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_check_read_deadline,(png_structrp png_ptr),
+    PNG_EMPTY);
+#endif
+
 PNG_INTERNAL_FUNCTION(void,png_handle_unknown,(png_structrp png_ptr,
     png_inforp info_ptr, png_uint_32 length, int keep),PNG_EMPTY);
    /* This is the function that gets called for unknown chunks.  The 'keep'
@@ -2038,8 +2142,10 @@ typedef struct png_control
    png_infop   info_ptr;
    png_voidp   error_buf;           /* Always a jmp_buf at present. */
 
-   png_const_bytep memory;          /* Memory buffer. */
-   size_t          size;            /* Size of the memory buffer. */
+#if PNG_MMAP_READ_OPT > 0
+   png_voidp       mapping;         /* Memory mapped file, or NULL */
+   size_t          mapping_size;    /* Size of the mapping */
+#endif
 
    unsigned int for_write       :1; /* Otherwise it is a read structure */
    unsigned int owned_file      :1; /* We own the file in io_ptr */
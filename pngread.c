@@ -14,10 +14,26 @@
  * read a PNG file or stream.
  */
 
+/* The Linux memory mapped file input (see PNG_MMAP_READ_OPT in pngpriv.h) uses
+ * madvise and MAP_POPULATE, which are not in POSIX 1003.1 and must be
+ * requested before any system header is included.  The option is off by
+ * default, so only builds that turn it on in CPPFLAGS change the feature test
+ * macros.
+ */
+#if defined(__linux__) && defined(PNG_MMAP_READ_OPT) && \
+   PNG_MMAP_READ_OPT > 0 && !defined(_DEFAULT_SOURCE)
+#  define _DEFAULT_SOURCE 1
+#endif
+
 #include "pngpriv.h"
 #if defined(PNG_SIMPLIFIED_READ_SUPPORTED) && defined(PNG_STDIO_SUPPORTED)
 #  include <errno.h>
 #endif
+#if PNG_MMAP_READ_OPT > 0
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#endif
 
 #ifdef PNG_READ_SUPPORTED
 
@@ -383,6 +399,7 @@ void PNGAPI
 png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
 {
    png_row_info row_info;
+   int swap_rows;
 
    if (png_ptr == NULL)
       return;
@@ -545,18 +562,36 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
    if (png_ptr->row_buf[0] > PNG_FILTER_VALUE_NONE)
    {
       if (png_ptr->row_buf[0] < PNG_FILTER_VALUE_LAST)
+      {
+         png_stats_begin(png_ptr, PNG_STAGE_FILTER, 0);
          png_read_filter_row(png_ptr, &row_info, png_ptr->row_buf + 1,
              png_ptr->prev_row + 1, png_ptr->row_buf[0]);
+         png_stats_end(png_ptr, PNG_STAGE_FILTER, row_info.rowbytes);
+      }
+
       else
          png_error(png_ptr, "bad adaptive filter value");
    }
 
+   /* The unfiltered row is needed to unfilter the next row.  If nothing is
+    * going to modify it the row buffers are simply swapped once the row has
+    * been stored, otherwise it must be copied now.
+    */
+   swap_rows = png_ptr->transformations == 0;
+
+#ifdef PNG_MNG_FEATURES_SUPPORTED
+   if ((png_ptr->mng_features_permitted & PNG_FLAG_MNG_FILTER_64) != 0 &&
+       (png_ptr->filter_type == PNG_INTRAPIXEL_DIFFERENCING))
+      swap_rows = 0;
+#endif
+
    /* libpng 1.5.6: the following line was copying png_ptr->rowbytes before
     * 1.5.6, while the buffer really is this big in current versions of libpng
     * it may not be in the future, so this was changed just to copy the
     * interlaced count:
     */
-   memcpy(png_ptr->prev_row, png_ptr->row_buf, row_info.rowbytes + 1);
+   if (swap_rows == 0)
+      memcpy(png_ptr->prev_row, png_ptr->row_buf, row_info.rowbytes + 1);
 
 #ifdef PNG_MNG_FEATURES_SUPPORTED
    if ((png_ptr->mng_features_permitted & PNG_FLAG_MNG_FILTER_64) != 0 &&
@@ -569,7 +604,11 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
 
 #ifdef PNG_READ_TRANSFORMS_SUPPORTED
    if (png_ptr->transformations)
+   {
+      png_stats_begin(png_ptr, PNG_STAGE_TRANSFORM, 0);
       png_do_read_transformations(png_ptr, &row_info);
+      png_stats_end(png_ptr, PNG_STAGE_TRANSFORM, row_info.rowbytes);
+   }
 #endif
 
    /* The transformed pixel depth should match the depth now in row_info. */
@@ -583,6 +622,8 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
    else if (png_ptr->transformed_pixel_depth != row_info.pixel_depth)
       png_error(png_ptr, "internal sequential row size calculation error");
 
+   png_stats_begin(png_ptr, PNG_STAGE_COMBINE, 0);
+
 #ifdef PNG_READ_INTERLACING_SUPPORTED
    /* Expand interlaced rows to full size */
    if (png_ptr->interlaced != 0 &&
@@ -608,6 +649,17 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
       if (dsp_row != NULL)
          png_combine_row(png_ptr, dsp_row, -1/*ignored*/);
    }
+
+   png_stats_end(png_ptr, PNG_STAGE_COMBINE, row_info.rowbytes);
+
+   if (swap_rows != 0)
+   {
+      png_bytep prev_row = png_ptr->prev_row;
+
+      png_ptr->prev_row = png_ptr->row_buf;
+      png_ptr->row_buf = prev_row;
+   }
+
    png_read_finish_row(png_ptr);
 
    if (png_ptr->read_row_fn != NULL)
@@ -883,6 +935,11 @@ png_read_end(png_structrp png_ptr, png_inforp info_ptr)
          png_handle_pHYs(png_ptr, info_ptr, length);
 #endif
 
+#ifdef PNG_READ_reST_SUPPORTED
+      else if (chunk_name == png_reST)
+         png_handle_reST(png_ptr, info_ptr, length);
+#endif
+
 #ifdef PNG_READ_sBIT_SUPPORTED
       else if (chunk_name == png_sBIT)
          png_handle_sBIT(png_ptr, info_ptr, length);
@@ -952,6 +1009,11 @@ png_read_destroy(png_structrp png_ptr)
    png_free(png_ptr, png_ptr->read_buffer);
    png_ptr->read_buffer = NULL;
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+   png_free(png_ptr, png_ptr->read_ahead_buffer);
+   png_ptr->read_ahead_buffer = NULL;
+#endif
+
 #ifdef PNG_READ_QUANTIZE_SUPPORTED
    png_free(png_ptr, png_ptr->palette_lookup);
    png_ptr->palette_lookup = NULL;
@@ -994,8 +1056,7 @@ png_read_destroy(png_structrp png_ptr)
    png_ptr->chunk_list = NULL;
 #endif
 
-#if defined(PNG_READ_EXPAND_SUPPORTED) && \
-    defined(PNG_ARM_NEON_IMPLEMENTATION)
+#ifdef PNG_READ_EXPAND_SUPPORTED
    png_free(png_ptr, png_ptr->riffled_palette);
    png_ptr->riffled_palette = NULL;
 #endif
@@ -1498,6 +1559,65 @@ png_image_begin_read_from_stdio(png_imagep image, FILE* file)
    return 0;
 }
 
+#if PNG_MMAP_READ_OPT > 0
+/* Map an open regular file into memory and read it with the memory reader.
+ * The file is mapped through its descriptor, so the name is only resolved once
+ * and FIFOs and devices are never opened a second time.  Returns -1 if the
+ * file cannot be mapped, in which case nothing has been changed and the
+ * caller must read 'fp' through stdio, otherwise 'fp' has been closed and the
+ * result is that of reading the header.
+ */
+static int
+png_image_begin_read_from_mapping(png_imagep image, FILE *fp)
+{
+   int fd = fileno(fp);
+   struct stat st;
+   void *mapping = MAP_FAILED;
+   size_t size = 0;
+
+   if (fd < 0)
+      return -1;
+
+   if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+       (off_t)(size_t)st.st_size == st.st_size)
+   {
+      int flags = MAP_PRIVATE;
+
+#     if PNG_MMAP_READ_OPT > 1 && defined(MAP_POPULATE)
+         flags |= MAP_POPULATE;
+#     endif
+
+      size = (size_t)st.st_size;
+      mapping = mmap(NULL, size, PROT_READ, flags, fd, 0);
+   }
+
+   if (mapping == MAP_FAILED)
+      return -1;
+
+   /* The mapping remains valid after the file is closed. */
+   (void)fclose(fp);
+
+#  ifdef MADV_SEQUENTIAL
+      (void)madvise(mapping, size, MADV_SEQUENTIAL);
+#  endif
+
+   if (png_image_read_init(image) != 0)
+   {
+      png_controlp cp = image->opaque;
+
+      cp->mapping = mapping;
+      cp->mapping_size = size;
+      png_set_read_memory(cp->png_ptr, png_voidcast(png_const_bytep, mapping),
+          size);
+
+      return png_safe_execute(image, png_image_read_header, image);
+   }
+
+   (void)munmap(mapping, size);
+   return 0;
+}
+#endif /* MMAP_READ_OPT */
+
 int PNGAPI
 png_image_begin_read_from_file(png_imagep image, const char *file_name)
 {
@@ -1509,6 +1629,15 @@ png_image_begin_read_from_file(png_imagep image, const char *file_name)
 
          if (fp != NULL)
          {
+#           if PNG_MMAP_READ_OPT > 0
+            {
+               int result = png_image_begin_read_from_mapping(image, fp);
+
+               if (result >= 0)
+                  return result;
+            }
+#           endif
+
             if (png_image_read_init(image) != 0)
             {
                image->opaque->png_ptr->io_ptr = fp;
@@ -1537,36 +1666,6 @@ png_image_begin_read_from_file(png_imagep image, const char *file_name)
 }
 #endif /* STDIO */
 
-static void PNGCBAPI
-png_image_memory_read(png_structp png_ptr, png_bytep out, size_t need)
-{
-   if (png_ptr != NULL)
-   {
-      png_imagep image = png_voidcast(png_imagep, png_ptr->io_ptr);
-      if (image != NULL)
-      {
-         png_controlp cp = image->opaque;
-         if (cp != NULL)
-         {
-            png_const_bytep memory = cp->memory;
-            size_t size = cp->size;
-
-            if (memory != NULL && size >= need)
-            {
-               memcpy(out, memory, need);
-               cp->memory = memory + need;
-               cp->size = size - need;
-               return;
-            }
-
-            png_error(png_ptr, "read beyond end of data");
-         }
-      }
-
-      png_error(png_ptr, "invalid memory read");
-   }
-}
-
 int PNGAPI png_image_begin_read_from_memory(png_imagep image,
     png_const_voidp memory, size_t size)
 {
@@ -1576,14 +1675,11 @@ int PNGAPI png_image_begin_read_from_memory(png_imagep image,
       {
          if (png_image_read_init(image) != 0)
          {
-            /* Now set the IO functions to read from the memory buffer and
-             * store it into io_ptr.  Again do this in-place to avoid calling a
-             * libpng function that requires error handling.
+            /* Now set the IO functions to read from the memory buffer; this
+             * cannot fail so it does not require error handling.
              */
-            image->opaque->memory = png_voidcast(png_const_bytep, memory);
-            image->opaque->size = size;
-            image->opaque->png_ptr->io_ptr = image;
-            image->opaque->png_ptr->read_data_fn = png_image_memory_read;
+            png_set_read_memory(image->opaque->png_ptr,
+                png_voidcast(png_const_bytep, memory), size);
 
             return png_safe_execute(image, png_image_read_header, image);
          }
@@ -34,7 +34,11 @@ png_read_data(png_structrp png_ptr, png_bytep data, size_t length)
    png_debug1(4, "reading %d bytes", (int)length);
 
    if (png_ptr->read_data_fn != NULL)
+   {
+      png_stats_begin(png_ptr, PNG_STAGE_IO, 0);
       (*(png_ptr->read_data_fn))(png_ptr, data, length);
+      png_stats_end(png_ptr, PNG_STAGE_IO, length);
+   }
 
    else
       png_error(png_ptr, "Call to NULL read function");
@@ -116,5 +120,210 @@ png_set_read_fn(png_structrp png_ptr, png_voidp io_ptr,
 #ifdef PNG_WRITE_FLUSH_SUPPORTED
    png_ptr->output_flush_fn = NULL;
 #endif
+
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+   /* Data read ahead from the previous input must not be returned. */
+   png_free(png_ptr, png_ptr->read_ahead_buffer);
+   png_ptr->read_ahead_buffer = NULL;
+   png_ptr->read_ahead_fn = NULL;
+   png_ptr->read_ahead_next = png_ptr->read_ahead_end = 0;
+   png_ptr->read_ahead_limit = 0;
+#endif
+}
+
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* Call the application read-ahead function for up to size bytes */
+static size_t
+png_read_ahead_call(png_structrp png_ptr, png_bytep buffer, size_t size)
+{
+   size_t got = (*(png_ptr->read_ahead_fn))(png_ptr, buffer, size);
+
+   if (got == 0 || got > size)
+      png_error(png_ptr, "Read Error");
+
+   if (got < png_ptr->read_ahead_limit)
+      png_ptr->read_ahead_limit -= got;
+
+   else
+      png_ptr->read_ahead_limit = 0;
+
+   return got;
+}
+
+/* Refill the empty read_ahead_buffer with at least need bytes.  No more than
+ * read_ahead_limit bytes are requested beyond that, so the application is
+ * never asked for data that follows the PNG datastream.
+ */
+static void
+png_read_ahead_fill(png_structrp png_ptr, size_t need)
+{
+   size_t size = png_ptr->read_ahead_limit;
+
+   if (size > png_ptr->read_ahead_size)
+      size = png_ptr->read_ahead_size;
+
+   if (size < need)
+      size = need;
+
+   if (png_ptr->read_ahead_buffer == NULL)
+      png_ptr->read_ahead_buffer = png_voidcast(png_bytep,
+          png_malloc(png_ptr, png_ptr->read_ahead_size));
+
+   png_ptr->read_ahead_end = png_read_ahead_call(png_ptr,
+       png_ptr->read_ahead_buffer, size);
+   png_ptr->read_ahead_next = 0;
+}
+
+/* The read function installed by png_set_read_ahead_fn.  Requests are served
+ * from read_ahead_buffer, which is refilled by the application function as
+ * required.  Requests at least as big as the buffer (typically IDAT data) are
+ * passed straight to the application once the buffer is empty, so the data is
+ * not copied twice.
+ */
+static void PNGCBAPI
+png_read_ahead_data(png_structp png_ptr, png_bytep data, size_t length)
+{
+   while (length > 0)
+   {
+      size_t avail = png_ptr->read_ahead_end - png_ptr->read_ahead_next;
+
+      if (avail == 0)
+      {
+         if (length >= png_ptr->read_ahead_size)
+         {
+            size_t got = png_read_ahead_call(png_ptr, data, length);
+
+            data += got;
+            length -= got;
+         }
+
+         else
+            png_read_ahead_fill(png_ptr, length);
+
+         continue;
+      }
+
+      if (avail > length)
+         avail = length;
+
+      memcpy(data, png_ptr->read_ahead_buffer + png_ptr->read_ahead_next,
+          avail);
+      png_ptr->read_ahead_next += avail;
+      data += avail;
+      length -= avail;
+   }
+}
+
+void /* PRIVATE */
+png_read_ahead_chunk(png_structrp png_ptr, png_uint_32 length)
+{
+   if (png_ptr->read_data_fn == png_read_ahead_data)
+   {
+      /* The chunk data and CRC follow, then the header of the next chunk
+       * unless this is IEND.
+       */
+      size_t known = (size_t)length + 4;
+      size_t avail = png_ptr->read_ahead_end - png_ptr->read_ahead_next;
+
+      if (png_ptr->chunk_name != png_IEND)
+         known += 8;
+
+      png_ptr->read_ahead_limit = known > avail ? known - avail : 0;
+   }
+}
+
+void PNGAPI
+png_set_read_ahead_fn(png_structrp png_ptr, png_voidp io_ptr,
+    png_read_ahead_ptr read_ahead_fn, size_t buffer_size)
+{
+   png_debug(1, "in png_set_read_ahead_fn");
+
+   if (png_ptr == NULL)
+      return;
+
+   if (read_ahead_fn == NULL)
+   {
+      png_app_error(png_ptr, "png_set_read_ahead_fn: NULL function");
+      return;
+   }
+
+   if (buffer_size == 0)
+      buffer_size = PNG_READ_AHEAD_SIZE;
+
+   png_set_read_fn(png_ptr, io_ptr, png_read_ahead_data);
+   png_ptr->read_ahead_fn = read_ahead_fn;
+   png_ptr->read_ahead_size = buffer_size;
+}
+
+/* The read function installed by png_set_read_memory. */
+static void PNGCBAPI
+png_read_memory_data(png_structp png_ptr, png_bytep data, size_t length)
+{
+   if (length > png_ptr->read_memory_size)
+      png_error(png_ptr, "read beyond end of data");
+
+   memcpy(data, png_ptr->read_memory, length);
+   png_ptr->read_memory += length;
+   png_ptr->read_memory_size -= length;
+}
+
+void /* PRIVATE */
+png_set_read_memory(png_structrp png_ptr, png_const_bytep memory, size_t size)
+{
+   png_ptr->io_ptr = NULL;
+   png_ptr->read_data_fn = png_read_memory_data;
+   png_ptr->read_memory = memory;
+   png_ptr->read_memory_size = size;
+}
+
+png_const_bytep /* PRIVATE */
+png_read_data_direct(png_structrp png_ptr, size_t *length)
+{
+   png_const_bytep data;
+   size_t avail;
+
+   if (png_ptr->read_data_fn == png_read_memory_data)
+   {
+      data = png_ptr->read_memory;
+      avail = png_ptr->read_memory_size;
+
+      if (avail == 0)
+         png_error(png_ptr, "read beyond end of data");
+
+      if (avail > *length)
+         avail = *length;
+
+      png_ptr->read_memory += avail;
+      png_ptr->read_memory_size -= avail;
+   }
+
+   else if (png_ptr->read_data_fn == png_read_ahead_data &&
+       (png_ptr->read_ahead_end > png_ptr->read_ahead_next ||
+        *length < png_ptr->read_ahead_size))
+   {
+      /* Large reads into an empty buffer are left to png_read_ahead_data,
+       * which passes the caller's buffer straight to the application.
+       */
+      if (png_ptr->read_ahead_end == png_ptr->read_ahead_next)
+         png_read_ahead_fill(png_ptr, *length);
+
+      data = png_ptr->read_ahead_buffer + png_ptr->read_ahead_next;
+      avail = png_ptr->read_ahead_end - png_ptr->read_ahead_next;
+
+      if (avail > *length)
+         avail = *length;
+
+      png_ptr->read_ahead_next += avail;
+   }
+
+   else
+      return NULL;
+
+   png_stats_begin(png_ptr, PNG_STAGE_IO, 0);
+   png_stats_end(png_ptr, PNG_STAGE_IO, avail);
+
+   *length = avail;
+   return data;
 }
+#endif /* SEQUENTIAL_READ */
 #endif /* READ */
@@ -100,6 +100,30 @@ png_set_crc_action(png_structrp png_ptr, int crit_action, int ancil_action)
    }
 }
 
+void PNGAPI
+png_set_trusted_input(png_structrp png_ptr, int trusted)
+{
+   png_debug(1, "in png_set_trusted_input");
+
+   if (png_ptr == NULL)
+      return;
+
+   /* The flag also stops png_calculate_crc, so on a write struct it would
+    * produce chunks with bad CRCs.
+    */
+   if ((png_ptr->mode & PNG_IS_READ_STRUCT) == 0)
+   {
+      png_app_error(png_ptr, "png_set_trusted_input: invalid on write");
+      return;
+   }
+
+   if (trusted != 0)
+      png_ptr->flags |= PNG_FLAG_TRUSTED_INPUT;
+
+   else
+      png_ptr->flags &= ~PNG_FLAG_TRUSTED_INPUT;
+}
+
 #ifdef PNG_READ_TRANSFORMS_SUPPORTED
 /* Is it OK to set a transformation now?  Only if png_start_read_image or
  * png_read_update_info have not been called.  It is not necessary for the IHDR
@@ -2141,98 +2165,99 @@ defined(PNG_READ_USER_TRANSFORM_SUPPORTED)
 #endif
 }
 
-#ifdef PNG_READ_PACK_SUPPORTED
-/* Unpack pixels of 1, 2, or 4 bits per pixel into 1 byte per pixel,
- * without changing the actual values.  Thus, if you had a row with
- * a bit depth of 1, you would end up with bytes that only contained
- * the numbers 0 or 1.  If you would rather they contain 0 and 255, use
- * png_do_shift() after this.
+#if defined(PNG_READ_PACK_SUPPORTED) || defined(PNG_READ_EXPAND_SUPPORTED)
+/* Unpack the 1, 2 or 4-bit samples of a row into one byte per sample,
+ * multiplying each sample by 'scale'; this is 1 to keep the original values or
+ * 0xff, 0x55 or 0x11 to scale them up to the 8-bit range.  The row is
+ * processed from the end so it can be done in place, and all the samples in a
+ * whole input byte are written at once.
  */
 static void
-png_do_unpack(png_row_infop row_info, png_bytep row)
+png_unpack_samples(png_bytep row, png_uint_32 row_width, unsigned int bit_depth,
+    unsigned int scale)
 {
-   png_debug(1, "in png_do_unpack");
-
-   if (row_info->bit_depth < 8)
+   png_const_bytep sp = row + (((size_t)row_width * bit_depth + 7) >> 3);
+   png_bytep dp = row + (size_t)row_width;
+   unsigned int mask = (1U << bit_depth) - 1;
+   unsigned int samples = 8 / bit_depth; /* samples per input byte */
+   unsigned int partial = (unsigned int)(row_width % samples);
+   png_uint_32 n = row_width / samples;
+
+   if (partial > 0)
    {
-      png_uint_32 i;
-      png_uint_32 row_width=row_info->width;
-
-      switch (row_info->bit_depth)
-      {
-         case 1:
-         {
-            png_bytep sp = row + (size_t)((row_width - 1) >> 3);
-            png_bytep dp = row + (size_t)row_width - 1;
-            png_uint_32 shift = 7U - ((row_width + 7U) & 0x07);
-            for (i = 0; i < row_width; i++)
-            {
-               *dp = (png_byte)((*sp >> shift) & 0x01);
+      unsigned int v = *(--sp);
+      unsigned int shift = 8 - partial * bit_depth;
 
-               if (shift == 7)
-               {
-                  shift = 0;
-                  sp--;
-               }
-
-               else
-                  shift++;
+      for (; partial > 0; partial--, shift += bit_depth)
+         *(--dp) = (png_byte)(((v >> shift) & mask) * scale);
+   }
 
-               dp--;
-            }
-            break;
+   switch (bit_depth)
+   {
+      case 1:
+         for (; n > 0; n--)
+         {
+            unsigned int v = *(--sp);
+
+            dp -= 8;
+            dp[0] = (png_byte)(((v >> 7)       ) * scale);
+            dp[1] = (png_byte)(((v >> 6) & 0x01) * scale);
+            dp[2] = (png_byte)(((v >> 5) & 0x01) * scale);
+            dp[3] = (png_byte)(((v >> 4) & 0x01) * scale);
+            dp[4] = (png_byte)(((v >> 3) & 0x01) * scale);
+            dp[5] = (png_byte)(((v >> 2) & 0x01) * scale);
+            dp[6] = (png_byte)(((v >> 1) & 0x01) * scale);
+            dp[7] = (png_byte)(((v     ) & 0x01) * scale);
          }
+         break;
 
-         case 2:
+      case 2:
+         for (; n > 0; n--)
          {
+            unsigned int v = *(--sp);
 
-            png_bytep sp = row + (size_t)((row_width - 1) >> 2);
-            png_bytep dp = row + (size_t)row_width - 1;
-            png_uint_32 shift = ((3U - ((row_width + 3U) & 0x03)) << 1);
-            for (i = 0; i < row_width; i++)
-            {
-               *dp = (png_byte)((*sp >> shift) & 0x03);
-
-               if (shift == 6)
-               {
-                  shift = 0;
-                  sp--;
-               }
-
-               else
-                  shift += 2;
-
-               dp--;
-            }
-            break;
+            dp -= 4;
+            dp[0] = (png_byte)(((v >> 6)       ) * scale);
+            dp[1] = (png_byte)(((v >> 4) & 0x03) * scale);
+            dp[2] = (png_byte)(((v >> 2) & 0x03) * scale);
+            dp[3] = (png_byte)(((v     ) & 0x03) * scale);
          }
+         break;
 
-         case 4:
+      case 4:
+         for (; n > 0; n--)
          {
-            png_bytep sp = row + (size_t)((row_width - 1) >> 1);
-            png_bytep dp = row + (size_t)row_width - 1;
-            png_uint_32 shift = ((1U - ((row_width + 1U) & 0x01)) << 2);
-            for (i = 0; i < row_width; i++)
-            {
-               *dp = (png_byte)((*sp >> shift) & 0x0f);
+            unsigned int v = *(--sp);
 
-               if (shift == 4)
-               {
-                  shift = 0;
-                  sp--;
-               }
+            dp -= 2;
+            dp[0] = (png_byte)(((v >> 4)       ) * scale);
+            dp[1] = (png_byte)(((v     ) & 0x0f) * scale);
+         }
+         break;
 
-               else
-                  shift = 4;
+      default:
+         break;
+   }
+}
+#endif
 
-               dp--;
-            }
-            break;
-         }
+#ifdef PNG_READ_PACK_SUPPORTED
+/* Unpack pixels of 1, 2, or 4 bits per pixel into 1 byte per pixel,
+ * without changing the actual values.  Thus, if you had a row with
+ * a bit depth of 1, you would end up with bytes that only contained
+ * the numbers 0 or 1.  If you would rather they contain 0 and 255, use
+ * png_do_shift() after this.
+ */
+static void
+png_do_unpack(png_row_infop row_info, png_bytep row)
+{
+   png_debug(1, "in png_do_unpack");
 
-         default:
-            break;
-      }
+   if (row_info->bit_depth < 8)
+   {
+      png_uint_32 row_width=row_info->width;
+
+      png_unpack_samples(row, row_width, row_info->bit_depth, 1);
       row_info->bit_depth = 8;
       row_info->pixel_depth = (png_byte)(8 * row_info->channels);
       row_info->rowbytes = row_width * row_info->channels;
@@ -2854,6 +2879,87 @@ png_do_read_filler(png_row_infop row_info, png_bytep row,
 }
 #endif
 
+#ifdef PNG_READ_BGR_SUPPORTED
+/* Change RGB to BGR.  For 8-bit rows the filler or alpha swap which otherwise
+ * follows in png_do_read_transformations is done at the same time, so BGRX,
+ * XBGR and ABGR pixels are produced in one pass over the row.  The return
+ * value has the flags of any such transformations which have been done.
+ */
+static png_uint_32
+png_do_read_bgr(png_structrp png_ptr, png_row_infop row_info, png_bytep row)
+{
+   png_debug(1, "in png_do_read_bgr");
+
+   if (row_info->bit_depth == 8)
+   {
+      png_uint_32 row_width = row_info->width;
+      png_uint_32 i;
+
+#ifdef PNG_READ_FILLER_SUPPORTED
+      if (row_info->color_type == PNG_COLOR_TYPE_RGB &&
+          (png_ptr->transformations & PNG_FILLER) != 0)
+      {
+         png_byte filler = (png_byte)png_ptr->filler;
+         png_bytep sp = row + (size_t)row_width * 3;
+         png_bytep dp = row + (size_t)row_width * 4;
+
+         if ((png_ptr->flags & PNG_FLAG_FILLER_AFTER) != 0)
+         {
+            /* This changes the data from RGB to BGRX */
+            for (i = 0; i < row_width; i++)
+            {
+               png_byte red, green, blue;
+
+               sp -= 3; dp -= 4;
+               red = sp[0]; green = sp[1]; blue = sp[2];
+               dp[0] = blue; dp[1] = green; dp[2] = red; dp[3] = filler;
+            }
+         }
+
+         else
+         {
+            /* This changes the data from RGB to XBGR */
+            for (i = 0; i < row_width; i++)
+            {
+               png_byte red, green, blue;
+
+               sp -= 3; dp -= 4;
+               red = sp[0]; green = sp[1]; blue = sp[2];
+               dp[0] = filler; dp[1] = blue; dp[2] = green; dp[3] = red;
+            }
+         }
+
+         row_info->channels = 4;
+         row_info->pixel_depth = 32;
+         row_info->rowbytes = row_width * 4;
+         return PNG_FILLER;
+      }
+#endif
+
+#ifdef PNG_READ_SWAP_ALPHA_SUPPORTED
+      if (row_info->color_type == PNG_COLOR_TYPE_RGB_ALPHA &&
+          (png_ptr->transformations & PNG_SWAP_ALPHA) != 0)
+      {
+         png_bytep rp = row;
+
+         /* This changes the data from RGBA to ABGR */
+         for (i = 0; i < row_width; i++, rp += 4)
+         {
+            png_byte red = rp[0], green = rp[1], blue = rp[2], alpha = rp[3];
+
+            rp[0] = alpha; rp[1] = blue; rp[2] = green; rp[3] = red;
+         }
+
+         return PNG_SWAP_ALPHA;
+      }
+#endif
+   }
+
+   png_do_bgr(row_info, row);
+   return 0;
+}
+#endif
+
 #ifdef PNG_READ_GRAY_TO_RGB_SUPPORTED
 /* Expand grayscale files to RGB, with or without alpha */
 static void
@@ -2943,6 +3049,35 @@ png_do_gray_to_rgb(png_row_infop row_info, png_bytep row)
 #endif
 
 #ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+#ifdef PNG_READ_GAMMA_SUPPORTED
+/* Build the table used for 8-bit RGB to gray conversion with gamma correction.
+ * It holds three 256 entry tables giving the weighted linear value of each
+ * channel, so that the sum of three entries shifted right by 15 is the linear
+ * gray value.  The rounding term is included in the blue table.  The table
+ * depends on gamma_to_1 and is freed with it in png_destroy_gamma_table.
+ */
+static void
+png_rgb_to_gray_table(png_structrp png_ptr, png_uint_32 rc, png_uint_32 gc,
+    png_uint_32 bc)
+{
+   png_const_bytep gamma_to_1 = png_ptr->gamma_to_1;
+   png_uint_32p table = png_voidcast(png_uint_32p, png_malloc(png_ptr,
+       3 * 256 * (sizeof (png_uint_32))));
+   unsigned int i;
+
+   for (i = 0; i < 256; i++)
+   {
+      png_uint_32 linear = gamma_to_1[i];
+
+      table[i] = rc * linear;
+      table[256 + i] = gc * linear;
+      table[512 + i] = bc * linear + 16384;
+   }
+
+   png_ptr->rgb_to_gray_table = table;
+}
+#endif
+
 /* Reduce RGB files to grayscale, with or without alpha
  * using the equation given in Poynton's ColorFAQ of 1998-01-04 at
  * <http://www.inforamp.net/~poynton/>  (THIS LINK IS DEAD June 2008 but
@@ -3023,8 +3158,21 @@ png_do_rgb_to_gray(png_structrp png_ptr, png_row_infop row_info, png_bytep row)
          {
             png_bytep sp = row;
             png_bytep dp = row;
+            png_const_bytep gamma_from_1 = png_ptr->gamma_from_1;
+            png_const_bytep gamma_table = png_ptr->gamma_table;
+            png_const_uint_32p red_1, green_1, blue_1;
             png_uint_32 i;
 
+            /* The linearization and the coefficient multiply are done with a
+             * single lookup per channel; see png_rgb_to_gray_table.
+             */
+            if (png_ptr->rgb_to_gray_table == NULL)
+               png_rgb_to_gray_table(png_ptr, rc, gc, bc);
+
+            red_1 = png_ptr->rgb_to_gray_table;
+            green_1 = red_1 + 256;
+            blue_1 = red_1 + 512;
+
             for (i = 0; i < row_width; i++)
             {
                png_byte red   = *(sp++);
@@ -3033,13 +3181,9 @@ png_do_rgb_to_gray(png_structrp png_ptr, png_row_infop row_info, png_bytep row)
 
                if (red != green || red != blue)
                {
-                  red = png_ptr->gamma_to_1[red];
-                  green = png_ptr->gamma_to_1[green];
-                  blue = png_ptr->gamma_to_1[blue];
-
                   rgb_error |= 1;
-                  *(dp++) = png_ptr->gamma_from_1[
-                      (rc*red + gc*green + bc*blue + 16384)>>15];
+                  *(dp++) = gamma_from_1[
+                      (red_1[red] + green_1[green] + blue_1[blue])>>15];
                }
 
                else
@@ -3047,8 +3191,8 @@ png_do_rgb_to_gray(png_structrp png_ptr, png_row_infop row_info, png_bytep row)
                   /* If there is no overall correction the table will not be
                    * set.
                    */
-                  if (png_ptr->gamma_table != NULL)
-                     red = png_ptr->gamma_table[red];
+                  if (gamma_table != NULL)
+                     red = gamma_table[red];
 
                   *(dp++) = red;
                }
@@ -4202,6 +4346,34 @@ png_do_encode_alpha(png_row_infop row_info, png_bytep row, png_structrp png_ptr)
 #endif
 
 #ifdef PNG_READ_EXPAND_SUPPORTED
+#ifndef PNG_ARM_NEON_INTRINSICS_AVAILABLE
+/* Build an RGBA8 palette from the separate RGB and alpha palettes, so that
+ * png_do_expand_palette can expand each pixel with a single four byte copy.
+ * This is done when the first row is transformed, after any changes that
+ * png_init_read_transformations makes to the palette.
+ */
+static void
+png_riffle_palette(png_structrp png_ptr)
+{
+   png_const_colorp palette = png_ptr->palette;
+   png_const_bytep trans_alpha = png_ptr->trans_alpha;
+   png_bytep riffled_palette = png_ptr->riffled_palette;
+   int num_trans = png_ptr->num_trans;
+   int i;
+
+   png_debug(1, "in png_riffle_palette");
+
+   for (i = 0; i < 256; i++, riffled_palette += 4)
+   {
+      riffled_palette[0] = palette[i].red;
+      riffled_palette[1] = palette[i].green;
+      riffled_palette[2] = palette[i].blue;
+      riffled_palette[3] = (png_byte)(i < num_trans ?
+          trans_alpha[i] : 0xff);
+   }
+}
+#endif
+
 /* Expands a palette row to an RGB or RGBA row depending
  * upon whether you supply trans and num_trans.
  */
@@ -4210,7 +4382,6 @@ png_do_expand_palette(png_structrp png_ptr, png_row_infop row_info,
     png_bytep row, png_const_colorp palette, png_const_bytep trans_alpha,
     int num_trans)
 {
-   int shift, value;
    png_bytep sp, dp;
    png_uint_32 i;
    png_uint_32 row_width=row_info->width;
@@ -4221,84 +4392,7 @@ png_do_expand_palette(png_structrp png_ptr, png_row_infop row_info,
    {
       if (row_info->bit_depth < 8)
       {
-         switch (row_info->bit_depth)
-         {
-            case 1:
-            {
-               sp = row + (size_t)((row_width - 1) >> 3);
-               dp = row + (size_t)row_width - 1;
-               shift = 7 - (int)((row_width + 7) & 0x07);
-               for (i = 0; i < row_width; i++)
-               {
-                  if ((*sp >> shift) & 0x01)
-                     *dp = 1;
-
-                  else
-                     *dp = 0;
-
-                  if (shift == 7)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
-
-                  else
-                     shift++;
-
-                  dp--;
-               }
-               break;
-            }
-
-            case 2:
-            {
-               sp = row + (size_t)((row_width - 1) >> 2);
-               dp = row + (size_t)row_width - 1;
-               shift = (int)((3 - ((row_width + 3) & 0x03)) << 1);
-               for (i = 0; i < row_width; i++)
-               {
-                  value = (*sp >> shift) & 0x03;
-                  *dp = (png_byte)value;
-                  if (shift == 6)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
-
-                  else
-                     shift += 2;
-
-                  dp--;
-               }
-               break;
-            }
-
-            case 4:
-            {
-               sp = row + (size_t)((row_width - 1) >> 1);
-               dp = row + (size_t)row_width - 1;
-               shift = (int)((row_width & 0x01) << 2);
-               for (i = 0; i < row_width; i++)
-               {
-                  value = (*sp >> shift) & 0x0f;
-                  *dp = (png_byte)value;
-                  if (shift == 4)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
-
-                  else
-                     shift += 4;
-
-                  dp--;
-               }
-               break;
-            }
-
-            default:
-               break;
-         }
+         png_unpack_samples(row, row_width, row_info->bit_depth, 1);
          row_info->bit_depth = 8;
          row_info->pixel_depth = 8;
          row_info->rowbytes = row_width;
@@ -4324,7 +4418,17 @@ png_do_expand_palette(png_structrp png_ptr, png_row_infop row_info,
                       &sp, &dp);
                }
 #else
-               PNG_UNUSED(png_ptr)
+               if (png_ptr->riffled_palette != NULL)
+               {
+                  png_const_bytep riffled_palette = png_ptr->riffled_palette;
+
+                  for (; i < row_width; i++)
+                  {
+                     memcpy(dp - 3, riffled_palette + ((size_t)*sp << 2), 4);
+                     dp -= 4;
+                     sp--;
+                  }
+               }
 #endif
 
                for (; i < row_width; i++)
@@ -4383,7 +4487,6 @@ static void
 png_do_expand(png_row_infop row_info, png_bytep row,
     png_const_color_16p trans_color)
 {
-   int shift, value;
    png_bytep sp, dp;
    png_uint_32 i;
    png_uint_32 row_width=row_info->width;
@@ -4399,81 +4502,19 @@ png_do_expand(png_row_infop row_info, png_bytep row,
          switch (row_info->bit_depth)
          {
             case 1:
-            {
                gray = (gray & 0x01) * 0xff;
-               sp = row + (size_t)((row_width - 1) >> 3);
-               dp = row + (size_t)row_width - 1;
-               shift = 7 - (int)((row_width + 7) & 0x07);
-               for (i = 0; i < row_width; i++)
-               {
-                  if ((*sp >> shift) & 0x01)
-                     *dp = 0xff;
-
-                  else
-                     *dp = 0;
-
-                  if (shift == 7)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
-
-                  else
-                     shift++;
-
-                  dp--;
-               }
+               png_unpack_samples(row, row_width, 1, 0xff);
                break;
-            }
 
             case 2:
-            {
                gray = (gray & 0x03) * 0x55;
-               sp = row + (size_t)((row_width - 1) >> 2);
-               dp = row + (size_t)row_width - 1;
-               shift = (int)((3 - ((row_width + 3) & 0x03)) << 1);
-               for (i = 0; i < row_width; i++)
-               {
-                  value = (*sp >> shift) & 0x03;
-                  *dp = (png_byte)(value | (value << 2) | (value << 4) |
-                     (value << 6));
-                  if (shift == 6)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
-
-                  else
-                     shift += 2;
-
-                  dp--;
-               }
+               png_unpack_samples(row, row_width, 2, 0x55);
                break;
-            }
 
             case 4:
-            {
                gray = (gray & 0x0f) * 0x11;
-               sp = row + (size_t)((row_width - 1) >> 1);
-               dp = row + (size_t)row_width - 1;
-               shift = (int)((1 - ((row_width + 1) & 0x01)) << 2);
-               for (i = 0; i < row_width; i++)
-               {
-                  value = (*sp >> shift) & 0x0f;
-                  *dp = (png_byte)(value | (value << 4));
-                  if (shift == 4)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
-
-                  else
-                     shift = 4;
-
-                  dp--;
-               }
+               png_unpack_samples(row, row_width, 4, 0x11);
                break;
-            }
 
             default:
                break;
@@ -4739,6 +4780,10 @@ png_do_quantize(png_row_infop row_info, png_bytep row,
 void /* PRIVATE */
 png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
 {
+#ifdef PNG_READ_BGR_SUPPORTED
+   png_uint_32 done = 0; /* transformations already done with another */
+#endif
+
    png_debug(1, "in png_do_read_transformations");
 
    if (png_ptr->row_buf == NULL)
@@ -4782,6 +4827,12 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
                png_riffle_palette_neon(png_ptr);
             }
          }
+#else
+         if (png_ptr->num_trans > 0 && png_ptr->riffled_palette == NULL)
+         {
+            png_ptr->riffled_palette = (png_bytep)png_malloc(png_ptr, 256 * 4);
+            png_riffle_palette(png_ptr);
+         }
 #endif
          png_do_expand_palette(png_ptr, row_info, png_ptr->row_buf + 1,
              png_ptr->palette, png_ptr->trans_alpha, png_ptr->num_trans);
@@ -4985,7 +5036,7 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
 
 #ifdef PNG_READ_BGR_SUPPORTED
    if ((png_ptr->transformations & PNG_BGR) != 0)
-      png_do_bgr(row_info, png_ptr->row_buf + 1);
+      done = png_do_read_bgr(png_ptr, row_info, png_ptr->row_buf + 1);
 #endif
 
 #ifdef PNG_READ_PACKSWAP_SUPPORTED
@@ -4994,13 +5045,21 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
 #endif
 
 #ifdef PNG_READ_FILLER_SUPPORTED
-   if ((png_ptr->transformations & PNG_FILLER) != 0)
+   if ((png_ptr->transformations & PNG_FILLER) != 0
+#     ifdef PNG_READ_BGR_SUPPORTED
+       && (done & PNG_FILLER) == 0
+#     endif
+      )
       png_do_read_filler(row_info, png_ptr->row_buf + 1,
           (png_uint_32)png_ptr->filler, png_ptr->flags);
 #endif
 
 #ifdef PNG_READ_SWAP_ALPHA_SUPPORTED
-   if ((png_ptr->transformations & PNG_SWAP_ALPHA) != 0)
+   if ((png_ptr->transformations & PNG_SWAP_ALPHA) != 0
+#     ifdef PNG_READ_BGR_SUPPORTED
+       && (done & PNG_SWAP_ALPHA) == 0
+#     endif
+      )
       png_do_read_swap_alpha(row_info, png_ptr->row_buf + 1);
 #endif
 
@@ -184,6 +184,18 @@ png_read_chunk_header(png_structrp png_ptr)
    /* Check for too-large chunk length */
    png_check_chunk_length(png_ptr, length);
 
+#ifdef PNG_USER_LIMITS_SUPPORTED
+   png_check_chunk_count(png_ptr);
+#endif
+
+#ifdef PNG_READ_reST_SUPPORTED
+   png_count_IDAT(png_ptr, length);
+#endif
+
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+   png_read_ahead_chunk(png_ptr, length);
+#endif
+
 #ifdef PNG_IO_STATE_SUPPORTED
    png_ptr->io_state = PNG_IO_READING | PNG_IO_CHUNK_DATA;
 #endif
@@ -254,7 +266,10 @@ png_crc_error(png_structrp png_ptr)
    png_uint_32 crc;
    int need_crc = 1;
 
-   if (PNG_CHUNK_ANCILLARY(png_ptr->chunk_name) != 0)
+   if ((png_ptr->flags & PNG_FLAG_TRUSTED_INPUT) != 0)
+      need_crc = 0;
+
+   else if (PNG_CHUNK_ANCILLARY(png_ptr->chunk_name) != 0)
    {
       if ((png_ptr->flags & PNG_FLAG_CRC_ANCILLARY_MASK) ==
           (PNG_FLAG_CRC_ANCILLARY_USE | PNG_FLAG_CRC_ANCILLARY_NOWARN))
@@ -421,11 +436,15 @@ png_inflate_claim(png_structrp png_ptr, png_uint_32 owner)
             png_ptr->flags |= PNG_FLAG_ZSTREAM_INITIALIZED;
       }
 
-#if ZLIB_VERNUM >= 0x1290 && \
-   defined(PNG_SET_OPTION_SUPPORTED) && defined(PNG_IGNORE_ADLER32)
-      if (((png_ptr->options >> PNG_IGNORE_ADLER32) & 3) == PNG_OPTION_ON)
+#if ZLIB_VERNUM >= 0x1290
+      if ((png_ptr->flags & PNG_FLAG_TRUSTED_INPUT) != 0)
+         ret = inflateValidate(&png_ptr->zstream, 0);
+
+#  if defined(PNG_SET_OPTION_SUPPORTED) && defined(PNG_IGNORE_ADLER32)
+      else if (((png_ptr->options >> PNG_IGNORE_ADLER32) & 3) == PNG_OPTION_ON)
          /* Turn off validation of the ADLER32 checksum in IDAT chunks */
          ret = inflateValidate(&png_ptr->zstream, 0);
+#  endif
 #endif
 
       if (ret == Z_OK)
@@ -563,6 +582,10 @@ png_inflate(png_structrp png_ptr, png_uint_32 owner, int finish,
           */
          ret = PNG_INFLATE(png_ptr, avail_out > 0 ? Z_NO_FLUSH :
              (finish ? Z_FINISH : Z_SYNC_FLUSH));
+
+#ifdef PNG_USER_LIMITS_SUPPORTED
+         png_check_inflate_limits(png_ptr);
+#endif
       } while (ret == Z_OK);
 
       /* For safety kill the local buffer pointer now */
@@ -813,6 +836,10 @@ png_inflate_read(png_structrp png_ptr, png_bytep read_buffer, uInt read_size,
           */
          ret = PNG_INFLATE(png_ptr, *chunk_bytes > 0 ?
              Z_NO_FLUSH : (finish ? Z_FINISH : Z_SYNC_FLUSH));
+
+#ifdef PNG_USER_LIMITS_SUPPORTED
+         png_check_inflate_limits(png_ptr);
+#endif
       }
       while (ret == Z_OK && (*out_size > 0 || png_ptr->zstream.avail_out > 0));
 
@@ -2094,6 +2121,145 @@ png_handle_eXIf(png_structrp png_ptr, png_inforp info_ptr, png_uint_32 length)
 }
 #endif
 
+#ifdef PNG_READ_reST_SUPPORTED
+void /* PRIVATE */
+png_count_IDAT(png_structrp png_ptr, png_uint_32 length)
+{
+   if (png_ptr->chunk_name == png_IDAT)
+   {
+      if (length < PNG_UINT_32_MAX - png_ptr->idat_read_total)
+         png_ptr->idat_read_total += length;
+
+      else
+         png_ptr->idat_read_total = PNG_UINT_32_MAX;
+   }
+}
+
+/* The private reST chunk written by png_write_end for an image written with the
+ * PNG_FLUSH_RESTART option; see png_write_reST for the format.  The entries are
+ * checked to be in order and within the image and the IDAT data so that an
+ * application can use them directly; anything else is treated as a damaged
+ * chunk.
+ */
+void /* PRIVATE */
+png_handle_reST(png_structrp png_ptr, png_inforp info_ptr, png_uint_32 length)
+{
+   png_bytep buffer;
+   png_uint_32p points;
+   png_uint_32 num, i;
+
+   png_debug(1, "in png_handle_reST");
+
+#ifdef PNG_READ_UNKNOWN_CHUNKS_SUPPORTED
+   /* The chunk is private, so an application that reads unknown chunks itself
+    * or keeps all of them gets it in the same way as before libpng knew it.
+    * Keep settings for reST alone have already been handled by the caller.
+    */
+   {
+      int as_unknown = 0;
+
+#  ifdef PNG_SET_UNKNOWN_CHUNKS_SUPPORTED
+      if (png_ptr->unknown_default == PNG_HANDLE_CHUNK_ALWAYS)
+         as_unknown = 1;
+#  endif
+
+#  ifdef PNG_READ_USER_CHUNKS_SUPPORTED
+      if (png_ptr->read_user_chunk_fn != NULL)
+         as_unknown = 1;
+#  endif
+
+      if (as_unknown != 0)
+      {
+         png_handle_unknown(png_ptr, info_ptr, length,
+             PNG_HANDLE_CHUNK_AS_DEFAULT);
+         return;
+      }
+   }
+#endif
+
+   if ((png_ptr->mode & PNG_HAVE_IHDR) == 0)
+      png_chunk_error(png_ptr, "missing IHDR");
+
+   else if ((png_ptr->mode & PNG_HAVE_IDAT) == 0)
+   {
+      png_crc_finish(png_ptr, length);
+      png_chunk_benign_error(png_ptr, "out of place");
+      return;
+   }
+
+   else if (info_ptr == NULL)
+   {
+      /* png_read_end was called without an info struct to store it in. */
+      png_crc_finish(png_ptr, length);
+      return;
+   }
+
+   else if (info_ptr->restart_points != NULL)
+   {
+      png_crc_finish(png_ptr, length);
+      png_chunk_benign_error(png_ptr, "duplicate");
+      return;
+   }
+
+   else if (length == 0 || (length & 7) != 0 ||
+       png_ptr->interlaced != PNG_INTERLACE_NONE)
+   {
+      png_crc_finish(png_ptr, length);
+      png_chunk_benign_error(png_ptr, "invalid");
+      return;
+   }
+
+   buffer = png_read_buffer(png_ptr, length, 2/*silent*/);
+
+   if (buffer == NULL)
+   {
+      png_crc_finish(png_ptr, length);
+      png_chunk_benign_error(png_ptr, "out of memory");
+      return;
+   }
+
+   png_crc_read(png_ptr, buffer, length);
+
+   if (png_crc_finish(png_ptr, 0) != 0)
+      return;
+
+   num = length / 8;
+
+   /* Rows and offsets must both increase; an offset is never less than 2, the
+    * size of the zlib header, and there is always more data after it.
+    */
+   for (i = 0; i < num; i++)
+   {
+      png_uint_32 row = png_get_uint_32(buffer + 8*i);
+      png_uint_32 offset = png_get_uint_32(buffer + 8*i + 4);
+
+      if (row >= png_ptr->height || offset < 2 ||
+          offset >= png_ptr->idat_read_total || (i > 0 &&
+          (row <= png_get_uint_32(buffer + 8*i - 8) ||
+           offset <= png_get_uint_32(buffer + 8*i - 4))))
+      {
+         png_chunk_benign_error(png_ptr, "invalid");
+         return;
+      }
+   }
+
+   points = png_voidcast(png_uint_32p, png_malloc_base(png_ptr,
+       (png_alloc_size_t)num * 2 * (sizeof (png_uint_32))));
+
+   if (points == NULL)
+   {
+      png_chunk_benign_error(png_ptr, "out of memory");
+      return;
+   }
+
+   for (i = 0; i < 2*num; i++)
+      points[i] = png_get_uint_32(buffer + 4*i);
+
+   info_ptr->restart_points = points;
+   info_ptr->num_restart_points = num;
+}
+#endif /* READ_reST */
+
 #ifdef PNG_READ_hIST_SUPPORTED
 void /* PRIVATE */
 png_handle_hIST(png_structrp png_ptr, png_inforp info_ptr, png_uint_32 length)
@@ -2556,6 +2722,7 @@ png_handle_tEXt(png_structrp png_ptr, png_inforp info_ptr, png_uint_32 length)
 
    if (buffer == NULL)
    {
+      png_crc_finish(png_ptr, length);
       png_chunk_benign_error(png_ptr, "out of memory");
       return;
    }
@@ -3135,6 +3302,9 @@ png_check_chunk_name(png_const_structrp png_ptr, png_uint_32 chunk_name)
 
    png_debug(1, "in png_check_chunk_name");
 
+   if ((png_ptr->flags & PNG_FLAG_TRUSTED_INPUT) != 0)
+      return;
+
    for (i=1; i<=4; ++i)
    {
       int c = cn & 0xff;
@@ -3151,6 +3321,9 @@ png_check_chunk_length(png_const_structrp png_ptr, png_uint_32 length)
 {
    png_alloc_size_t limit = PNG_UINT_31_MAX;
 
+   if ((png_ptr->flags & PNG_FLAG_TRUSTED_INPUT) != 0)
+      return;
+
 # ifdef PNG_SET_USER_LIMITS_SUPPORTED
    if (png_ptr->user_chunk_malloc_max > 0 &&
        png_ptr->user_chunk_malloc_max < limit)
@@ -3186,6 +3359,77 @@ png_check_chunk_length(png_const_structrp png_ptr, png_uint_32 length)
    }
 }
 
+#ifdef PNG_USER_LIMITS_SUPPORTED
+void /* PRIVATE */
+png_check_chunk_count(png_structrp png_ptr)
+{
+   if (png_ptr->chunk_count < PNG_UINT_32_MAX)
+      ++png_ptr->chunk_count;
+
+   if (png_ptr->chunk_count_max > 0 &&
+       png_ptr->chunk_count > png_ptr->chunk_count_max)
+      png_chunk_error(png_ptr, "too many chunks");
+}
+
+/* The zlib running totals cover everything since the stream was claimed, so
+ * for IDAT the limits apply to the whole image.  The ratio is not checked
+ * until the output is large enough for the time spent to matter; very small
+ * compressed streams legitimately have high ratios.
+ */
+#define PNG_INFLATE_RATIO_MIN_OUTPUT 65536U
+
+void /* PRIVATE */
+png_check_inflate_limits(png_structrp png_ptr)
+{
+   png_alloc_size_t total_out = png_ptr->zstream.total_out;
+   png_alloc_size_t size_max;
+
+   switch (png_ptr->zowner)
+   {
+      case png_zTXt:
+         size_max = png_ptr->inflate_zTXt_max;
+         break;
+
+      case png_iTXt:
+         size_max = png_ptr->inflate_iTXt_max;
+         break;
+
+      case png_iCCP:
+         size_max = png_ptr->inflate_iCCP_max;
+         break;
+
+      case png_IDAT:
+         size_max = png_ptr->inflate_IDAT_max;
+         break;
+
+      default:
+         size_max = 0;
+         break;
+   }
+
+   if (size_max > 0 && total_out > size_max)
+      png_chunk_error(png_ptr, "decompressed size limit exceeded");
+
+   if (png_ptr->inflate_ratio_max > 0 &&
+       total_out > PNG_INFLATE_RATIO_MIN_OUTPUT &&
+       total_out / png_ptr->inflate_ratio_max > png_ptr->zstream.total_in)
+      png_chunk_error(png_ptr, "compression ratio limit exceeded");
+}
+
+void /* PRIVATE */
+png_check_read_deadline(png_structrp png_ptr)
+{
+   if (png_ptr->read_deadline_fn != NULL &&
+       ++png_ptr->read_deadline_count >= png_ptr->read_deadline_rows)
+   {
+      png_ptr->read_deadline_count = 0;
+
+      if ((*png_ptr->read_deadline_fn)(png_ptr) != 0)
+         png_error(png_ptr, "read deadline exceeded");
+   }
+}
+#endif /* USER_LIMITS */
+
 /* Combines the row recently read in with the existing pixels in the row.  This
  * routine takes care of alpha and transparency if requested.  This routine also
  * handles the two methods of progressive display of interlaced images,
@@ -3542,6 +3786,47 @@ png_combine_row(png_const_structrp png_ptr, png_bytep dp, int display)
                   row_width -= bytes_to_jump;
                }
 
+            case 4:
+               /* RGBA or 16-bit GA, or two or four pixels in the 'block'
+                * case.  A fixed size memcpy compiles to a single unaligned
+                * load and store on most machines, so the alignment checks
+                * below are not needed.  The final copy may be partial in the
+                * 'block' case.
+                */
+               do
+               {
+                  memcpy(dp, sp, 4);
+
+                  if (row_width <= bytes_to_jump)
+                     return;
+
+                  sp += bytes_to_jump;
+                  dp += bytes_to_jump;
+                  row_width -= bytes_to_jump;
+               }
+               while (row_width >= 4);
+
+               memcpy(dp, sp, row_width);
+               return;
+
+            case 8:
+               /* As above for 16-bit RGBA: */
+               do
+               {
+                  memcpy(dp, sp, 8);
+
+                  if (row_width <= bytes_to_jump)
+                     return;
+
+                  sp += bytes_to_jump;
+                  dp += bytes_to_jump;
+                  row_width -= bytes_to_jump;
+               }
+               while (row_width >= 8);
+
+               memcpy(dp, sp, row_width);
+               return;
+
             default:
 #if PNG_ALIGN_TYPE != PNG_ALIGN_NONE
                /* Check for double byte alignment and, if possible, use a
@@ -3884,6 +4169,100 @@ png_do_read_interlace(png_row_infop row_info, png_bytep row, int pass,
             break;
          }
 
+         /* The common byte sized pixels are expanded with fixed size copies,
+          * which compilers turn into single loads and stores.  The expansion
+          * works backward from the end of the row, so the source pixel is
+          * always read before it is overwritten.
+          */
+         case 8:
+         {
+            png_bytep sp = row + (size_t)(row_info->width - 1);
+            size_t jstop = png_pass_inc[pass];
+            png_bytep dp = row + (size_t)final_width - jstop;
+            png_uint_32 i;
+
+            for (i = 0; i < row_info->width; i++)
+            {
+               memset(dp, *sp, jstop);
+               dp -= jstop;
+               sp--;
+            }
+            break;
+         }
+
+         case 24:
+         {
+            png_bytep sp = row + (size_t)(row_info->width - 1) * 3;
+            png_bytep dp = row + (size_t)(final_width - 1) * 3;
+            int jstop = (int)png_pass_inc[pass];
+            png_uint_32 i;
+
+            for (i = 0; i < row_info->width; i++)
+            {
+               png_byte v0 = sp[0], v1 = sp[1], v2 = sp[2];
+               int j;
+
+               for (j = 0; j < jstop; j++)
+               {
+                  dp[0] = v0; dp[1] = v1; dp[2] = v2;
+                  dp -= 3;
+               }
+
+               sp -= 3;
+            }
+            break;
+         }
+
+         case 32:
+         {
+            png_bytep sp = row + (size_t)(row_info->width - 1) * 4;
+            png_bytep dp = row + (size_t)(final_width - 1) * 4;
+            int jstop = (int)png_pass_inc[pass];
+            png_uint_32 i;
+
+            for (i = 0; i < row_info->width; i++)
+            {
+               png_byte v[4];
+               int j;
+
+               memcpy(v, sp, 4);
+
+               for (j = 0; j < jstop; j++)
+               {
+                  memcpy(dp, v, 4);
+                  dp -= 4;
+               }
+
+               sp -= 4;
+            }
+            break;
+         }
+
+         case 64:
+         {
+            png_bytep sp = row + (size_t)(row_info->width - 1) * 8;
+            png_bytep dp = row + (size_t)(final_width - 1) * 8;
+            int jstop = (int)png_pass_inc[pass];
+            png_uint_32 i;
+
+            for (i = 0; i < row_info->width; i++)
+            {
+               png_byte v[8];
+               int j;
+
+               memcpy(v, sp, 8);
+
+               for (j = 0; j < jstop; j++)
+               {
+                  memcpy(dp, v, 8);
+                  dp -= 8;
+               }
+
+               sp -= 8;
+            }
+            break;
+         }
+
          default:
          {
             size_t pixel_bytes = (row_info->pixel_depth >> 3);
@@ -4153,6 +4532,11 @@ png_read_IDAT_data(png_structrp png_ptr, png_bytep output,
    if (output == NULL)
       avail_out = 0;
 
+#ifdef PNG_USER_LIMITS_SUPPORTED
+   else /* one row */
+      png_check_read_deadline(png_ptr);
+#endif
+
    do
    {
       int ret;
@@ -4180,17 +4564,102 @@ png_read_IDAT_data(png_structrp png_ptr, png_bytep output,
          if (avail_in > png_ptr->idat_size)
             avail_in = (uInt)png_ptr->idat_size;
 
-         /* A PNG with a gradually increasing IDAT size will defeat this attempt
-          * to minimize memory usage by causing lots of re-allocs, but
-          * realistically doing IDAT_read_size re-allocs is not likely to be a
-          * big problem.
+         /* If the input is already in memory inflate it where it is; the CRC
+          * is calculated immediately before inflate reads the same bytes, so
+          * they are only fetched from main memory once.
           */
-         buffer = png_read_buffer(png_ptr, avail_in, 0/*error*/);
+         {
+            size_t length = avail_in;
+            png_const_bytep direct = png_read_data_direct(png_ptr, &length);
 
-         png_crc_read(png_ptr, buffer, avail_in);
-         png_ptr->idat_size -= avail_in;
+            if (direct != NULL)
+            {
+               avail_in = (uInt)length;
+               png_calculate_crc(png_ptr, direct, avail_in);
+               png_ptr->zstream.next_in = PNGZ_INPUT_CAST(direct);
+            }
 
-         png_ptr->zstream.next_in = buffer;
+            else
+            {
+               png_alloc_size_t buffer_size = avail_in;
+
+#              ifdef PNG_SET_OPTION_SUPPORTED
+               /* In the adaptive mode the whole of the chunk is read at once,
+                * up to the limit on chunk allocations, so files with large
+                * IDAT chunks need far fewer calls to the read function.  The
+                * buffer grows geometrically so that a series of increasing
+                * IDAT sizes only causes a few re-allocs.
+                */
+               if (((png_ptr->options >> PNG_ADAPTIVE_IDAT_READ) & 3) ==
+                   PNG_OPTION_ON && png_ptr->idat_size > avail_in)
+               {
+                  png_alloc_size_t limit = ZLIB_IO_MAX;
+
+#                 ifdef PNG_SET_USER_LIMITS_SUPPORTED
+                  if (png_ptr->user_chunk_malloc_max > 0 &&
+                      png_ptr->user_chunk_malloc_max < limit)
+                     limit = png_ptr->user_chunk_malloc_max;
+#                 elif PNG_USER_CHUNK_MALLOC_MAX > 0
+                  if (PNG_USER_CHUNK_MALLOC_MAX < limit)
+                     limit = PNG_USER_CHUNK_MALLOC_MAX;
+#                 endif
+
+                  if (limit > avail_in)
+                  {
+                     buffer_size = png_ptr->idat_size;
+
+                     if (buffer_size > limit)
+                        buffer_size = limit;
+
+                     avail_in = (uInt)buffer_size;
+
+                     if (buffer_size > png_ptr->read_buffer_size &&
+                         buffer_size < 2 * png_ptr->read_buffer_size)
+                     {
+                        buffer_size = 2 * png_ptr->read_buffer_size;
+
+                        if (buffer_size > limit)
+                           buffer_size = limit;
+                     }
+                  }
+               }
+#              endif
+
+#              ifdef PNG_MEMORY_BUDGET_SUPPORTED
+               /* Read smaller pieces rather than exceed the memory budget; the
+                * existing buffer is freed before a larger one is allocated.
+                * Half of what remains is left for zlib, which allocates its
+                * window in the first call to inflate.
+                */
+               {
+                  png_alloc_size_t limit = png_mem_available(png_ptr) / 2;
+
+                  if (limit <= PNG_SIZE_MAX - png_ptr->read_buffer_size)
+                     limit += png_ptr->read_buffer_size;
+
+                  if (buffer_size > limit && limit > 0)
+                  {
+                     buffer_size = limit;
+
+                     if (avail_in > buffer_size)
+                        avail_in = (uInt)buffer_size;
+                  }
+               }
+#              endif
+
+               /* Otherwise a PNG with a gradually increasing IDAT size will
+                * defeat this attempt to minimize memory usage by causing lots
+                * of re-allocs, but realistically doing IDAT_read_size re-allocs
+                * is not likely to be a big problem.
+                */
+               buffer = png_read_buffer(png_ptr, buffer_size, 0/*error*/);
+
+               png_crc_read(png_ptr, buffer, avail_in);
+               png_ptr->zstream.next_in = buffer;
+            }
+         }
+
+         png_ptr->idat_size -= avail_in;
          png_ptr->zstream.avail_in = avail_in;
       }
 
@@ -4219,7 +4688,13 @@ png_read_IDAT_data(png_structrp png_ptr, png_bytep output,
        *
        * TODO: deal more elegantly with truncated IDAT lists.
        */
+      png_stats_begin(png_ptr, PNG_STAGE_ZLIB, png_ptr->zstream.total_out);
       ret = PNG_INFLATE(png_ptr, Z_NO_FLUSH);
+      png_stats_end(png_ptr, PNG_STAGE_ZLIB, png_ptr->zstream.total_out);
+
+#ifdef PNG_USER_LIMITS_SUPPORTED
+      png_check_inflate_limits(png_ptr);
+#endif
 
       /* Take the unconsumed output back. */
       if (output != NULL)
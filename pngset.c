@@ -1622,6 +1622,35 @@ png_set_compression_buffer_size(png_structrp png_ptr, size_t size)
 #  endif
 }
 
+#ifdef PNG_WRITE_SUPPORTED
+void PNGAPI
+png_set_IDAT_chunk_size(png_structrp png_ptr, png_uint_32 size)
+{
+   if (png_ptr == NULL)
+      return;
+
+   if ((png_ptr->mode & PNG_IS_READ_STRUCT) != 0)
+   {
+      png_app_error(png_ptr, "png_set_IDAT_chunk_size: invalid on read");
+      return;
+   }
+
+   if (size > PNG_UINT_31_MAX)
+      size = PNG_UINT_31_MAX;
+
+   /* As for the compression buffer, deflate needs at least 6 bytes of output
+    * space to make progress on a SYNC_FLUSH.
+    */
+   if (size > 0 && size < 6)
+   {
+      png_warning(png_ptr, "IDAT chunk size cannot be reduced below 6");
+      return;
+   }
+
+   png_ptr->IDAT_chunk_size = size;
+}
+#endif
+
 void PNGAPI
 png_set_invalid(png_const_structrp png_ptr, png_inforp info_ptr, int mask)
 {
@@ -1663,8 +1692,74 @@ png_set_chunk_malloc_max(png_structrp png_ptr,
    if (png_ptr != NULL)
       png_ptr->user_chunk_malloc_max = user_chunk_malloc_max;
 }
+
+void PNGAPI
+png_set_inflate_ratio_max(png_structrp png_ptr, png_uint_32 ratio_max)
+{
+   if (png_ptr != NULL)
+      png_ptr->inflate_ratio_max = ratio_max;
+}
+
+void PNGAPI
+png_set_inflate_size_max(png_structrp png_ptr, png_const_bytep chunk_name,
+    png_alloc_size_t size_max)
+{
+   if (png_ptr == NULL || chunk_name == NULL)
+      return;
+
+   switch (PNG_CHUNK_FROM_STRING(chunk_name))
+   {
+      case png_zTXt:
+         png_ptr->inflate_zTXt_max = size_max;
+         break;
+
+      case png_iTXt:
+         png_ptr->inflate_iTXt_max = size_max;
+         break;
+
+      case png_iCCP:
+         png_ptr->inflate_iCCP_max = size_max;
+         break;
+
+      case png_IDAT:
+         png_ptr->inflate_IDAT_max = size_max;
+         break;
+
+      default:
+         png_app_error(png_ptr, "png_set_inflate_size_max: invalid chunk");
+         break;
+   }
+}
+
+void PNGAPI
+png_set_chunk_count_max(png_structrp png_ptr, png_uint_32 chunk_count_max)
+{
+   if (png_ptr != NULL)
+      png_ptr->chunk_count_max = chunk_count_max;
+}
+
+void PNGAPI
+png_set_read_deadline_fn(png_structrp png_ptr,
+    png_read_deadline_ptr deadline_fn, png_uint_32 rows)
+{
+   if (png_ptr == NULL)
+      return;
+
+   png_ptr->read_deadline_fn = deadline_fn;
+   png_ptr->read_deadline_rows = rows > 0 ? rows : 1;
+   png_ptr->read_deadline_count = 0;
+}
 #endif /* ?SET_USER_LIMITS */
 
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+void PNGAPI
+png_set_memory_budget(png_structrp png_ptr, png_alloc_size_t budget)
+{
+   if (png_ptr != NULL)
+      png_ptr->mem_budget = budget;
+}
+#endif /* MEMORY_BUDGET */
+
 
 #ifdef PNG_BENIGN_ERRORS_SUPPORTED
 void PNGAPI
@@ -1710,6 +1805,22 @@ png_set_check_for_invalid_index(png_structrp png_ptr, int allowed)
 }
 #endif
 
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+void PNGAPI
+png_set_pipeline_stats_clock(png_structrp png_ptr, png_stats_clock_ptr clock_fn)
+{
+   png_debug(1, "in png_set_pipeline_stats_clock");
+
+   if (png_ptr == NULL)
+      return;
+
+   png_ptr->stats_clock_fn = clock_fn;
+   memset(png_ptr->stats_calls, 0, (sizeof png_ptr->stats_calls));
+   memset(png_ptr->stats_bytes, 0, (sizeof png_ptr->stats_bytes));
+   memset(png_ptr->stats_ticks, 0, (sizeof png_ptr->stats_ticks));
+}
+#endif /* PIPELINE_STATS */
+
 #if defined(PNG_TEXT_SUPPORTED) || defined(PNG_pCAL_SUPPORTED) || \
     defined(PNG_iCCP_SUPPORTED) || defined(PNG_sPLT_SUPPORTED)
 /* Check that the tEXt or zTXt keyword is valid per PNG 1.0 specification,
@@ -157,6 +157,23 @@ struct png_struct_def
    png_rw_ptr read_data_fn;   /* function for reading input data */
    png_voidp io_ptr;          /* ptr to application struct for I/O functions */
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+   png_read_ahead_ptr read_ahead_fn; /* fills read_ahead_buffer */
+   png_bytep read_ahead_buffer;      /* data read but not yet used */
+   size_t read_ahead_size;           /* allocated size of the buffer */
+   size_t read_ahead_next;           /* offset of the next unused byte */
+   size_t read_ahead_end;            /* end of the valid data */
+   size_t read_ahead_limit;          /* bytes known to follow the buffer */
+   png_const_bytep read_memory;      /* next byte of an in-memory source */
+   size_t read_memory_size;          /* bytes remaining at read_memory */
+#endif
+
+#ifdef PNG_WRITE_SUPPORTED
+   png_bytep write_buffer;           /* output not yet written */
+   size_t write_buffer_size;         /* 0 if output is not buffered */
+   size_t write_buffer_used;         /* bytes pending in write_buffer */
+#endif
+
 #ifdef PNG_READ_USER_TRANSFORM_SUPPORTED
    png_user_transform_ptr read_user_transform_fn; /* user read transform */
 #endif
@@ -186,12 +203,23 @@ struct png_struct_def
    png_compression_bufferp zbuffer_list; /* Created on demand during write */
    uInt                    zbuffer_size; /* size of the actual buffer */
 
+   /* IDAT output is collected in zbuffer_list until there are IDAT_chunk_size
+    * bytes (0: write each buffer as it fills).  IDAT_pending is the number of
+    * bytes in the full buffers before IDAT_buffer, the one being filled.
+    */
+   png_uint_32             IDAT_chunk_size;
+   png_uint_32             IDAT_pending;
+   png_compression_bufferp IDAT_buffer;
+
    int zlib_level;            /* holds zlib compression level */
    int zlib_method;           /* holds zlib compression method */
    int zlib_window_bits;      /* holds zlib compression window bits */
    int zlib_mem_level;        /* holds zlib compression memory level */
    int zlib_strategy;         /* holds zlib compression strategy */
 #endif
+#ifdef PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED
+   int compression_preset;    /* PNG_COMPRESSION_ preset not yet applied */
+#endif
 /* Added at libpng 1.5.4 */
 #ifdef PNG_WRITE_CUSTOMIZE_ZTXT_COMPRESSION_SUPPORTED
    int zlib_text_level;            /* holds zlib compression level */
@@ -235,6 +263,9 @@ struct png_struct_def
    size_t info_rowbytes;      /* Added in 1.5.4: cache of updated row bytes */
 
    png_uint_32 idat_size;     /* current IDAT size for read */
+#ifdef PNG_READ_reST_SUPPORTED
+   png_uint_32 idat_read_total; /* IDAT data read so far, for reST checks */
+#endif
    png_uint_32 crc;           /* current chunk CRC value */
    png_colorp palette;        /* palette from the input file */
    png_uint_16 num_palette;   /* number of color entries in palette */
@@ -286,6 +317,12 @@ struct png_struct_def
    png_uint_32 flush_rows;    /* number of rows written since last flush */
 #endif
 
+#ifdef PNG_WRITE_reST_SUPPORTED
+   png_uint_32p restart_points;    /* row, offset pairs for the reST chunk */
+   png_uint_32 num_restart_points; /* number of pairs recorded */
+   png_uint_32 max_restart_points; /* number of pairs allocated */
+#endif
+
 #ifdef PNG_READ_GAMMA_SUPPORTED
    int gamma_shift;      /* number of "insignificant" bits in 16-bit gamma */
    png_fixed_point screen_gamma; /* screen gamma value (display_exponent) */
@@ -300,6 +337,9 @@ struct png_struct_def
    png_uint_16pp gamma_16_from_1; /* converts from 1.0 to screen */
    png_uint_16pp gamma_16_to_1; /* converts from file to 1.0 */
 #endif /* READ_BACKGROUND || READ_ALPHA_MODE || RGB_TO_GRAY */
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+   png_uint_32p rgb_to_gray_table; /* weighted gamma_to_1 for each channel */
+#endif
 #endif
 
 #if defined(PNG_READ_GAMMA_SUPPORTED) || defined(PNG_sBIT_SUPPORTED)
@@ -322,6 +362,9 @@ struct png_struct_def
    png_progressive_info_ptr info_fn; /* called after header data fully read */
    png_progressive_row_ptr row_fn;   /* called after a prog. row is decoded */
    png_progressive_end_ptr end_fn;   /* called after image is complete */
+   png_bytepp frame_rows;            /* rows combined by libpng, if set */
+   int frame_display;                /* PNG_FRAME_ method of combining */
+   png_progressive_frame_ptr frame_fn; /* called after each pass */
    png_bytep save_buffer_ptr;        /* current location in save_buffer */
    png_bytep save_buffer;            /* buffer for previously read data */
    png_bytep current_buffer_ptr;     /* current location in current_buffer */
@@ -392,9 +435,17 @@ struct png_struct_def
    /* deleted in 1.5.5: rgb_to_gray_blue_coeff; */
 #endif
 
+#ifdef PNG_PIPELINE_STATS_SUPPORTED
+   png_stats_clock_ptr stats_clock_fn;          /* application clock or NULL */
+   png_uint_32 stats_start[PNG_STAGE_COUNT];    /* clock at start of a stage */
+   png_alloc_size_t stats_base[PNG_STAGE_COUNT]; /* byte count at start */
+   png_uint_32 stats_calls[PNG_STAGE_COUNT];
+   png_alloc_size_t stats_bytes[PNG_STAGE_COUNT];
+   png_alloc_size_t stats_ticks[PNG_STAGE_COUNT];
+#endif
+
 /* New member added in libpng-1.6.36 */
-#if defined(PNG_READ_EXPAND_SUPPORTED) && \
-    defined(PNG_ARM_NEON_IMPLEMENTATION)
+#ifdef PNG_READ_EXPAND_SUPPORTED
    png_bytep riffled_palette; /* buffer for accelerated palette expansion */
 #endif
 
@@ -446,6 +497,29 @@ struct png_struct_def
     * can occupy when decompressed.  0 means unlimited.
     */
    png_alloc_size_t user_chunk_malloc_max;
+
+   /* Decompression budgets, 0 means unlimited.  The sizes limit the output of
+    * zlib for each chunk type (for IDAT the whole image) and the ratio that
+    * output to the compressed input.
+    */
+   png_uint_32 inflate_ratio_max;
+   png_alloc_size_t inflate_zTXt_max;
+   png_alloc_size_t inflate_iTXt_max;
+   png_alloc_size_t inflate_iCCP_max;
+   png_alloc_size_t inflate_IDAT_max;
+
+   png_uint_32 chunk_count;          /* chunks read so far */
+   png_uint_32 chunk_count_max;      /* limit on chunk_count, 0 for none */
+
+   png_read_deadline_ptr read_deadline_fn; /* called every deadline_rows */
+   png_uint_32 read_deadline_rows;
+   png_uint_32 read_deadline_count;  /* rows since the last call */
+#endif
+
+#ifdef PNG_MEMORY_BUDGET_SUPPORTED
+   png_alloc_size_t mem_budget;  /* limit on mem_live, 0 for no limit */
+   png_alloc_size_t mem_live;    /* bytes currently allocated */
+   png_alloc_size_t mem_peak;    /* maximum of mem_live */
 #endif
 
 /* New member added in libpng-1.0.25 and 1.2.17 */
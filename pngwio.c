@@ -32,15 +32,91 @@
 void /* PRIVATE */
 png_write_data(png_structrp png_ptr, png_const_bytep data, size_t length)
 {
+   /* If output is buffered small writes are collected in write_buffer; a write
+    * that does not fit in the remaining space flushes the buffer and is then
+    * either buffered or, if it is at least as big as the buffer, written
+    * directly.
+    */
+   if (png_ptr->write_buffer_size > 0)
+   {
+      if (length > png_ptr->write_buffer_size - png_ptr->write_buffer_used)
+         png_write_buffered_data(png_ptr);
+
+      if (length < png_ptr->write_buffer_size)
+      {
+         if (png_ptr->write_buffer == NULL)
+            png_ptr->write_buffer = png_voidcast(png_bytep,
+                png_malloc(png_ptr, png_ptr->write_buffer_size));
+
+         memcpy(png_ptr->write_buffer + png_ptr->write_buffer_used, data,
+             length);
+         png_ptr->write_buffer_used += length;
+         return;
+      }
+   }
+
    /* NOTE: write_data_fn must not change the buffer! */
    if (png_ptr->write_data_fn != NULL )
+   {
+      png_stats_begin(png_ptr, PNG_STAGE_IO, 0);
       (*(png_ptr->write_data_fn))(png_ptr, png_constcast(png_bytep,data),
           length);
+      png_stats_end(png_ptr, PNG_STAGE_IO, length);
+   }
 
    else
       png_error(png_ptr, "Call to NULL write function");
 }
 
+void /* PRIVATE */
+png_write_buffered_data(png_structrp png_ptr)
+{
+   size_t used = png_ptr->write_buffer_used;
+
+   if (used > 0)
+   {
+      /* Reset the count first so that an error in the write function does not
+       * cause the data to be written again.
+       */
+      png_ptr->write_buffer_used = 0;
+
+      if (png_ptr->write_data_fn != NULL)
+      {
+         png_stats_begin(png_ptr, PNG_STAGE_IO, 0);
+         (*(png_ptr->write_data_fn))(png_ptr, png_ptr->write_buffer, used);
+         png_stats_end(png_ptr, PNG_STAGE_IO, used);
+      }
+
+      else
+         png_error(png_ptr, "Call to NULL write function");
+   }
+}
+
+void PNGAPI
+png_set_write_buffer_size(png_structrp png_ptr, size_t buffer_size)
+{
+   png_debug(1, "in png_set_write_buffer_size");
+
+   if (png_ptr == NULL)
+      return;
+
+   if ((png_ptr->mode & PNG_IS_READ_STRUCT) != 0)
+   {
+      png_app_error(png_ptr, "png_set_write_buffer_size: invalid on read");
+      return;
+   }
+
+   /* Output already buffered is written out using the old buffer. */
+   png_write_buffered_data(png_ptr);
+
+   if (buffer_size != png_ptr->write_buffer_size)
+   {
+      png_free(png_ptr, png_ptr->write_buffer);
+      png_ptr->write_buffer = NULL;
+      png_ptr->write_buffer_size = buffer_size;
+   }
+}
+
 #ifdef PNG_STDIO_SUPPORTED
 /* This is the function that does the actual writing of data.  If you are
  * not writing to a standard C stream, you should create a replacement
@@ -70,6 +146,8 @@ png_default_write_data(png_structp png_ptr, png_bytep data, size_t length)
 void /* PRIVATE */
 png_flush(png_structrp png_ptr)
 {
+   png_write_buffered_data(png_ptr);
+
    if (png_ptr->output_flush_fn != NULL)
       (*(png_ptr->output_flush_fn))(png_ptr);
 }
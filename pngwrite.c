@@ -443,11 +443,21 @@ png_write_end(png_structrp png_ptr, png_inforp info_ptr)
 #endif
    }
 
+#ifdef PNG_WRITE_reST_SUPPORTED
+   /* Record any restart points made by png_write_flush */
+   if (png_ptr->num_restart_points > 0)
+      png_write_reST(png_ptr, png_ptr->restart_points,
+          png_ptr->num_restart_points);
+#endif
+
    png_ptr->mode |= PNG_AFTER_IDAT;
 
    /* Write end of PNG file */
    png_write_IEND(png_ptr);
 
+   /* Output collected by png_set_write_buffer_size must not be left behind. */
+   png_write_buffered_data(png_ptr);
+
    /* This flush, added in libpng-1.0.8, removed from libpng-1.0.9beta03,
     * and restored again in libpng-1.2.30, may cause some applications that
     * do not set png_ptr->output_flush_fn to crash.  If your application
@@ -565,6 +575,184 @@ png_create_write_struct_2,(png_const_charp user_png_ver, png_voidp error_ptr,
 }
 
 
+#ifdef PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED
+/* Image content classes used by PNG_COMPRESSION_AUTO */
+#define PNG_CONTENT_UNKNOWN   0 /* uniform sample, use the balanced settings */
+#define PNG_CONTENT_SYNTHETIC 1 /* runs of identical pixels and sharp edges */
+#define PNG_CONTENT_GRADIENT  2 /* flat areas and smooth gradients */
+#define PNG_CONTENT_PHOTO     3 /* few repeated pixels, mostly small changes */
+
+/* Classify a sample of rows, in the application's format, by comparing each
+ * pixel with the one to its left.  In synthetic images (screenshots, text,
+ * line art) the pixels change rarely and then by a lot; filtering only hides
+ * the repeated patterns from deflate.  In photographs and gradients the pixels
+ * change often but by a little, which the filters reduce to small residuals.
+ */
+static int
+png_write_classify(png_const_structrp png_ptr, png_const_bytep *rows,
+    unsigned int num_rows)
+{
+   unsigned int bpp = (png_ptr->usr_channels * png_ptr->usr_bit_depth) >> 3;
+   unsigned int step = png_ptr->usr_bit_depth == 16 ? 2 : 1;
+   unsigned int msb = 0; /* offset of the most significant byte of a sample */
+   png_uint_32 width = png_ptr->width;
+   png_alloc_size_t pixels = 0, same = 0, small = 0;
+   unsigned int r;
+
+   /* Without interlace handling the first rows are from the first pass */
+   if (png_ptr->interlaced != 0 &&
+       (png_ptr->transformations & PNG_INTERLACE) == 0)
+      width = (width + 7) >> 3;
+
+   /* After png_set_swap the application rows are little-endian */
+   if (step == 2 && (png_ptr->transformations & PNG_SWAP_BYTES) != 0)
+      msb = 1;
+
+   for (r = 0; r < num_rows; r++)
+   {
+      png_const_bytep rp = rows[r];
+      png_uint_32 x;
+
+      for (x = 1; x < width; x++, rp += bpp)
+      {
+         unsigned int c, diff = 0;
+
+         /* For 16-bit samples only the most significant byte is compared */
+         for (c = 0; c < bpp; c += step)
+         {
+            int d = rp[c + msb + bpp] - rp[c + msb];
+
+            if (d < 0)
+               d = -d;
+
+            if ((unsigned int)d > diff)
+               diff = (unsigned int)d;
+         }
+
+         pixels++;
+
+         if (diff == 0)
+            same++;
+
+         else if (diff <= 16)
+            small++;
+      }
+   }
+
+   if (same == pixels)
+      return PNG_CONTENT_UNKNOWN;
+
+   if (small < (pixels - same) / 2)
+      return PNG_CONTENT_SYNTHETIC;
+
+   if (same < pixels / 2)
+      return PNG_CONTENT_PHOTO;
+
+   return PNG_CONTENT_GRADIENT;
+}
+
+/* Replace the filter and IDAT zlib settings with those of the preset.  This
+ * is called once, before png_write_start_row allocates the filter buffers,
+ * with the rows available at that point.
+ */
+static void
+png_write_apply_preset(png_structrp png_ptr, png_const_bytep *rows,
+    unsigned int num_rows)
+{
+   int filters = PNG_ALL_FILTERS;
+
+   png_debug(1, "in png_write_apply_preset");
+
+   /* Unless a strategy is set below png_deflate_claim picks one according to
+    * whether or not the rows are filtered.
+    */
+   png_ptr->flags &= ~PNG_FLAG_ZLIB_CUSTOM_STRATEGY;
+   png_ptr->zlib_level = 6;
+   png_ptr->zlib_mem_level = 8;
+   png_ptr->zlib_window_bits = 15;
+
+   switch (png_ptr->compression_preset)
+   {
+      case PNG_COMPRESSION_FASTEST:
+         /* SUB costs little and keeps most of the gain of the full set */
+         png_ptr->zlib_level = 1;
+         filters = PNG_FILTER_SUB;
+         break;
+
+      case PNG_COMPRESSION_SMALLEST:
+         png_ptr->zlib_level = 9;
+         png_ptr->zlib_mem_level = 9;
+         break;
+
+      case PNG_COMPRESSION_AUTO:
+         switch (png_write_classify(png_ptr, rows, num_rows))
+         {
+            case PNG_CONTENT_SYNTHETIC:
+               filters = PNG_FILTER_NONE;
+               break;
+
+            case PNG_CONTENT_PHOTO:
+               /* The filtered rows of a photograph have few long matches;
+                * Z_RLE gives the same size as Z_FILTERED in a third of the
+                * time.
+                */
+               png_ptr->flags |= PNG_FLAG_ZLIB_CUSTOM_STRATEGY;
+#ifdef Z_RLE
+               png_ptr->zlib_strategy = Z_RLE;
+#else
+               png_ptr->zlib_strategy = Z_FILTERED;
+#endif
+               break;
+
+            default:
+               break;
+         }
+         break;
+
+      default: /* PNG_COMPRESSION_BALANCED */
+         break;
+   }
+
+   png_ptr->compression_preset = PNG_COMPRESSION_DEFAULT;
+
+   /* Palette and low bit depth images are never filtered, as in
+    * png_write_IHDR.
+    */
+   if (png_ptr->color_type == PNG_COLOR_TYPE_PALETTE ||
+       png_ptr->bit_depth < 8)
+      filters = PNG_FILTER_NONE;
+
+#ifdef PNG_WRITE_FILTER_SUPPORTED
+   png_ptr->do_filter = (png_byte)filters;
+#else
+   PNG_UNUSED(filters)
+#endif
+}
+
+/* Apply a pending preset to up to eight rows spread evenly through the
+ * num_rows rows that are about to be written.  This only happens before the
+ * first row; otherwise png_write_row has already applied the preset.
+ */
+static void
+png_write_sample_preset(png_structrp png_ptr, png_bytepp rows,
+    png_uint_32 num_rows)
+{
+   if (png_ptr->compression_preset != PNG_COMPRESSION_DEFAULT &&
+       png_ptr->row_number == 0 && png_ptr->pass == 0 && num_rows > 0)
+   {
+      png_const_bytep sample[8];
+      unsigned int num_sample = num_rows < 8 ? (unsigned int)num_rows : 8;
+      png_uint_32 spacing = num_rows / num_sample;
+      unsigned int i;
+
+      for (i = 0; i < num_sample; i++)
+         sample[i] = rows[i * spacing + spacing / 2];
+
+      png_write_apply_preset(png_ptr, sample, num_sample);
+   }
+}
+#endif /* WRITE_CUSTOMIZE_COMPRESSION */
+
 /* Write a few rows of image data.  If the image is interlaced,
  * either you will have to write the 7 sub images, or, if you
  * have called png_set_interlace_handling(), you will have to
@@ -582,6 +770,10 @@ png_write_rows(png_structrp png_ptr, png_bytepp row,
    if (png_ptr == NULL)
       return;
 
+#ifdef PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED
+   png_write_sample_preset(png_ptr, row, num_rows);
+#endif
+
    /* Loop through the rows */
    for (i = 0, rp = row; i < num_rows; i++, rp++)
    {
@@ -612,6 +804,14 @@ png_write_image(png_structrp png_ptr, png_bytepp image)
 #else
    num_pass = 1;
 #endif
+
+#ifdef PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED
+   /* The whole image is available, so the preset can look at rows from
+    * throughout it rather than just the first.
+    */
+   png_write_sample_preset(png_ptr, image, png_ptr->height);
+#endif
+
    /* Loop through passes */
    for (pass = 0; pass < num_pass; pass++)
    {
@@ -746,6 +946,11 @@ png_write_row(png_structrp png_ptr, png_const_bytep row)
          png_warning(png_ptr, "PNG_WRITE_SWAP_SUPPORTED is not defined");
 #endif
 
+#ifdef PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED
+      if (png_ptr->compression_preset != PNG_COMPRESSION_DEFAULT)
+         png_write_apply_preset(png_ptr, &row, 1);
+#endif
+
       png_write_start_row(png_ptr);
    }
 
@@ -833,15 +1038,15 @@ png_write_row(png_structrp png_ptr, png_const_bytep row)
    png_debug1(3, "row_info->pixel_depth = %d", row_info.pixel_depth);
    png_debug1(3, "row_info->rowbytes = %lu", (unsigned long)row_info.rowbytes);
 
-   /* Copy user's row into buffer, leaving room for filter byte. */
-   memcpy(png_ptr->row_buf + 1, row, row_info.rowbytes);
-
 #ifdef PNG_WRITE_INTERLACING_SUPPORTED
-   /* Handle interlacing */
+   /* Handle interlacing; the pixels for the pass are copied straight from the
+    * user's row into the buffer, leaving room for the filter byte.
+    */
    if (png_ptr->interlaced && png_ptr->pass < 6 &&
        (png_ptr->transformations & PNG_INTERLACE) != 0)
    {
-      png_do_write_interlace(&row_info, png_ptr->row_buf + 1, png_ptr->pass);
+      png_do_write_interlace(&row_info, row, png_ptr->row_buf + 1,
+          png_ptr->pass);
       /* This should always get caught above, but still ... */
       if (row_info.width == 0)
       {
@@ -849,12 +1054,20 @@ png_write_row(png_structrp png_ptr, png_const_bytep row)
          return;
       }
    }
+
+   else
 #endif
+   /* Copy user's row into buffer, leaving room for filter byte. */
+   memcpy(png_ptr->row_buf + 1, row, row_info.rowbytes);
 
 #ifdef PNG_WRITE_TRANSFORMS_SUPPORTED
    /* Handle other transformations */
    if (png_ptr->transformations != 0)
+   {
+      png_stats_begin(png_ptr, PNG_STAGE_TRANSFORM, 0);
       png_do_write_transformations(png_ptr, &row_info);
+      png_stats_end(png_ptr, PNG_STAGE_TRANSFORM, row_info.rowbytes);
+   }
 #endif
 
    /* At this point the row_info pixel depth must match the 'transformed' depth,
@@ -910,6 +1123,67 @@ png_set_flush(png_structrp png_ptr, int nrows)
    png_ptr->flush_dist = (nrows < 0 ? 0 : (png_uint_32)nrows);
 }
 
+#ifdef PNG_WRITE_reST_SUPPORTED
+/* Add the restart point just made by png_write_flush to the list written in the
+ * reST chunk by png_write_end.  The point is the number of the next row and the
+ * offset of the next byte in the zlib stream.  Points are not recorded for
+ * interlaced images, where the row number does not identify a position in the
+ * image, nor beyond 4GByte of compressed data.  A recording failure loses only
+ * that point; the image itself is unaffected.
+ */
+static void
+png_write_restart_point(png_structrp png_ptr)
+{
+   png_uint_32 offset = (png_uint_32)png_ptr->zstream.total_out;
+   png_uint_32 num = png_ptr->num_restart_points;
+
+   if (png_ptr->interlaced != PNG_INTERLACE_NONE ||
+       offset != png_ptr->zstream.total_out)
+      return;
+
+   /* A second flush with no rows in between moves the last point on. */
+   if (num > 0 && png_ptr->restart_points[2*num - 2] == png_ptr->row_number)
+   {
+      png_ptr->restart_points[2*num - 1] = offset;
+      return;
+   }
+
+   if (num >= png_ptr->max_restart_points)
+   {
+      /* The limit keeps the chunk length within PNG_UINT_31_MAX. */
+      png_uint_32 max = num < 16 ? 16 : 2*num;
+      png_uint_32p points;
+
+      if (max > PNG_UINT_31_MAX/8)
+         max = PNG_UINT_31_MAX/8;
+
+      if (num >= max)
+         return;
+
+      points = png_voidcast(png_uint_32p, png_malloc_base(png_ptr,
+          (png_alloc_size_t)max * 2 * (sizeof (png_uint_32))));
+
+      if (points == NULL)
+      {
+         png_warning(png_ptr, "Restart point not recorded: out of memory");
+         return;
+      }
+
+      if (num > 0)
+         memcpy(points, png_ptr->restart_points,
+             (size_t)num * 2 * (sizeof (png_uint_32)));
+
+      png_free(png_ptr, png_ptr->restart_points);
+      png_ptr->restart_points = points;
+      png_ptr->max_restart_points = max;
+   }
+
+   png_ptr->restart_points[2*num] = png_ptr->row_number;
+   png_ptr->restart_points[2*num + 1] = offset;
+   png_ptr->num_restart_points = num + 1;
+}
+#endif
+
 /* Flush the current output buffers now */
 void PNGAPI
 png_write_flush(png_structrp png_ptr)
@@ -923,7 +1197,26 @@ png_write_flush(png_structrp png_ptr)
    if (png_ptr->row_number >= png_ptr->num_rows)
       return;
 
-   png_compress_IDAT(png_ptr, NULL, 0, Z_SYNC_FLUSH);
+#ifdef PNG_SET_OPTION_SUPPORTED
+   /* A full flush also resets the deflate dictionary, so a decoder can start
+    * inflating at this point without any of the preceding data.  The next row
+    * must then not be filtered against the row before it, otherwise it could
+    * not be reconstructed independently; png_write_find_filter checks the
+    * flag set here.  The point is recorded for the reST chunk.
+    */
+   if (((png_ptr->options >> PNG_FLUSH_RESTART) & 3) == PNG_OPTION_ON)
+   {
+      png_compress_IDAT(png_ptr, NULL, 0, Z_FULL_FLUSH);
+      png_ptr->flags |= PNG_FLAG_RESTART_ROW;
+#ifdef PNG_WRITE_reST_SUPPORTED
+      png_write_restart_point(png_ptr);
+#endif
+   }
+
+   else
+#endif
+      png_compress_IDAT(png_ptr, NULL, 0, Z_SYNC_FLUSH);
+
    png_ptr->flush_rows = 0;
    png_flush(png_ptr);
 }
@@ -943,6 +1236,10 @@ png_write_destroy(png_structrp png_ptr)
    png_free_buffer_list(png_ptr, &png_ptr->zbuffer_list);
    png_free(png_ptr, png_ptr->row_buf);
    png_ptr->row_buf = NULL;
+   png_free(png_ptr, png_ptr->write_buffer);
+   png_ptr->write_buffer = NULL;
+   png_ptr->write_buffer_size = 0;
+   png_ptr->write_buffer_used = 0;
 #ifdef PNG_WRITE_FILTER_SUPPORTED
    png_free(png_ptr, png_ptr->prev_row);
    png_free(png_ptr, png_ptr->try_row);
@@ -957,6 +1254,11 @@ png_write_destroy(png_structrp png_ptr)
    png_ptr->chunk_list = NULL;
 #endif
 
+#ifdef PNG_WRITE_reST_SUPPORTED
+   png_free(png_ptr, png_ptr->restart_points);
+   png_ptr->restart_points = NULL;
+#endif
+
    /* The error handling and memory handling information is left intact at this
     * point: the jmp_buf may still have to be freed.  See png_destroy_png_struct
     * for how this happens.
@@ -1231,6 +1533,23 @@ png_set_compression_method(png_structrp png_ptr, int method)
 
    png_ptr->zlib_method = method;
 }
+
+void PNGAPI
+png_set_compression_preset(png_structrp png_ptr, int preset)
+{
+   png_debug(1, "in png_set_compression_preset");
+
+   if (png_ptr == NULL)
+      return;
+
+   if (preset < PNG_COMPRESSION_DEFAULT || preset > PNG_COMPRESSION_AUTO)
+   {
+      png_app_error(png_ptr, "invalid compression preset");
+      return;
+   }
+
+   png_ptr->compression_preset = preset;
+}
 #endif /* WRITE_CUSTOMIZE_COMPRESSION */
 
 /* The following were added to libpng-1.5.4 */
@@ -2200,6 +2519,12 @@ png_image_write_memory(png_voidp argument)
    png_set_write_fn(display->image->opaque->png_ptr, display/*io_ptr*/,
        image_memory_write, image_memory_flush);
 
+   /* The output is all in memory, so a single IDAT chunk costs no more than a
+    * second copy of the compressed image and saves the per-chunk overhead for
+    * the reader.
+    */
+   png_set_IDAT_chunk_size(display->image->opaque->png_ptr, PNG_UINT_31_MAX);
+
    return png_image_write_main(display);
 }
 
@@ -29,37 +29,36 @@ png_do_pack(png_row_infop row_info, png_bytep row, png_uint_32 bit_depth)
    if (row_info->bit_depth == 8 &&
       row_info->channels == 1)
    {
+      png_const_bytep sp = row;
+      png_bytep dp = row;
+      png_uint_32 row_width = row_info->width;
+      png_uint_32 i;
+
+      /* All the samples for a whole output byte are combined at once, then
+       * any remaining samples are packed into the last byte.
+       */
       switch ((int)bit_depth)
       {
          case 1:
          {
-            png_bytep sp, dp;
             int mask, v;
-            png_uint_32 i;
-            png_uint_32 row_width = row_info->width;
 
-            sp = row;
-            dp = row;
+            for (i = row_width >> 3; i > 0; i--, sp += 8)
+               *(dp++) = (png_byte)(
+                   ((sp[0] != 0) << 7) | ((sp[1] != 0) << 6) |
+                   ((sp[2] != 0) << 5) | ((sp[3] != 0) << 4) |
+                   ((sp[4] != 0) << 3) | ((sp[5] != 0) << 2) |
+                   ((sp[6] != 0) << 1) | (sp[7] != 0));
+
             mask = 0x80;
             v = 0;
 
-            for (i = 0; i < row_width; i++)
+            for (i = row_width & 0x07; i > 0; i--, sp++)
             {
                if (*sp != 0)
                   v |= mask;
 
-               sp++;
-
-               if (mask > 1)
-                  mask >>= 1;
-
-               else
-               {
-                  mask = 0x80;
-                  *dp = (png_byte)v;
-                  dp++;
-                  v = 0;
-               }
+               mask >>= 1;
             }
 
             if (mask != 0x80)
@@ -70,36 +69,21 @@ png_do_pack(png_row_infop row_info, png_bytep row, png_uint_32 bit_depth)
 
          case 2:
          {
-            png_bytep sp, dp;
             unsigned int shift;
             int v;
-            png_uint_32 i;
-            png_uint_32 row_width = row_info->width;
 
-            sp = row;
-            dp = row;
+            for (i = row_width >> 2; i > 0; i--, sp += 4)
+               *(dp++) = (png_byte)(
+                   ((sp[0] & 0x03) << 6) | ((sp[1] & 0x03) << 4) |
+                   ((sp[2] & 0x03) << 2) | (sp[3] & 0x03));
+
             shift = 6;
             v = 0;
 
-            for (i = 0; i < row_width; i++)
+            for (i = row_width & 0x03; i > 0; i--, sp++)
             {
-               png_byte value;
-
-               value = (png_byte)(*sp & 0x03);
-               v |= (value << shift);
-
-               if (shift == 0)
-               {
-                  shift = 6;
-                  *dp = (png_byte)v;
-                  dp++;
-                  v = 0;
-               }
-
-               else
-                  shift -= 2;
-
-               sp++;
+               v |= (*sp & 0x03) << shift;
+               shift -= 2;
             }
 
             if (shift != 6)
@@ -110,40 +94,11 @@ png_do_pack(png_row_infop row_info, png_bytep row, png_uint_32 bit_depth)
 
          case 4:
          {
-            png_bytep sp, dp;
-            unsigned int shift;
-            int v;
-            png_uint_32 i;
-            png_uint_32 row_width = row_info->width;
-
-            sp = row;
-            dp = row;
-            shift = 4;
-            v = 0;
-
-            for (i = 0; i < row_width; i++)
-            {
-               png_byte value;
-
-               value = (png_byte)(*sp & 0x0f);
-               v |= (value << shift);
-
-               if (shift == 0)
-               {
-                  shift = 4;
-                  *dp = (png_byte)v;
-                  dp++;
-                  v = 0;
-               }
-
-               else
-                  shift -= 4;
-
-               sp++;
-            }
+            for (i = row_width >> 1; i > 0; i--, sp += 2)
+               *(dp++) = (png_byte)(((sp[0] & 0x0f) << 4) | (sp[1] & 0x0f));
 
-            if (shift != 4)
-               *dp = (png_byte)v;
+            if ((row_width & 0x01) != 0)
+               *dp = (png_byte)((*sp & 0x0f) << 4);
 
             break;
          }
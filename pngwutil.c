@@ -910,17 +910,69 @@ png_write_PLTE(png_structrp png_ptr, png_const_colorp palette,
    png_ptr->mode |= PNG_HAVE_PLTE;
 }
 
+/* Return the output space for the next IDAT buffer: a whole buffer unless the
+ * requested IDAT chunk size is smaller.
+ */
+static uInt
+png_IDAT_buffer_avail(png_const_structrp png_ptr)
+{
+   if (png_ptr->IDAT_chunk_size > 0 &&
+       png_ptr->IDAT_chunk_size < png_ptr->zbuffer_size)
+      return png_ptr->IDAT_chunk_size;
+
+   return png_ptr->zbuffer_size;
+}
+
+/* Write the collected IDAT output, 'length' bytes starting at the head of the
+ * buffer list, as a single chunk and start filling the list again.
+ */
+static void
+png_write_IDAT_buffers(png_structrp png_ptr, png_uint_32 length)
+{
+   png_compression_bufferp next = png_ptr->zbuffer_list;
+
+   /* The first IDAT may need deflate header optimization. */
+#ifdef PNG_WRITE_OPTIMIZE_CMF_SUPPORTED
+   if ((png_ptr->mode & PNG_HAVE_IDAT) == 0 &&
+       png_ptr->compression_type == PNG_COMPRESSION_TYPE_BASE)
+      optimize_cmf(next->output, png_image_size(png_ptr));
+#endif
+
+   png_write_chunk_header(png_ptr, png_IDAT, length);
+
+   while (length > 0)
+   {
+      uInt avail = png_ptr->zbuffer_size;
+
+      if (avail > length)
+         avail = (uInt)length;
+
+      png_write_chunk_data(png_ptr, next->output, avail);
+      length -= avail;
+      next = next->next;
+   }
+
+   png_write_chunk_end(png_ptr);
+   png_ptr->mode |= PNG_HAVE_IDAT;
+
+   png_ptr->IDAT_buffer = png_ptr->zbuffer_list;
+   png_ptr->IDAT_pending = 0;
+}
+
 /* This is similar to png_text_compress, above, except that it does not require
  * all of the data at once and, instead of buffering the compressed result,
  * writes it as IDAT chunks.  Unlike png_text_compress it *can* png_error out
  * because it calls the write interface.  As a result it does its own error
  * reporting and does not return an error code.  In the event of error it will
- * just call png_error.  The input data length may exceed 32-bits.  The 'flush'
- * parameter is exactly the same as that to deflate, with the following
+ * just call png_error.  The input data length may exceed 32-bits.  IDAT chunks
+ * are written as each buffer fills or, if png_set_IDAT_chunk_size was called,
+ * when enough buffers have been filled to make a chunk of that size.  The
+ * 'flush' parameter is exactly the same as that to deflate, with the following
  * meanings:
  *
  * Z_NO_FLUSH: normal incremental output of compressed data
  * Z_SYNC_FLUSH: do a SYNC_FLUSH, used by png_write_flush
+ * Z_FULL_FLUSH: do a FULL_FLUSH, used by png_write_flush for PNG_FLUSH_RESTART
  * Z_FINISH: this is the end of the input, do a Z_FINISH and clean up
  *
  * The routine manages the acquire and release of the png_ptr->zstream by
@@ -955,8 +1007,10 @@ png_compress_IDAT(png_structrp png_ptr, png_const_bytep input,
       /* The output state is maintained in png_ptr->zstream, so it must be
        * initialized here after the claim.
        */
+      png_ptr->IDAT_buffer = png_ptr->zbuffer_list;
+      png_ptr->IDAT_pending = 0;
       png_ptr->zstream.next_out = png_ptr->zbuffer_list->output;
-      png_ptr->zstream.avail_out = png_ptr->zbuffer_size;
+      png_ptr->zstream.avail_out = png_IDAT_buffer_avail(png_ptr);
    }
 
    /* Now loop reading and writing until all the input is consumed or an error
@@ -978,7 +1032,9 @@ png_compress_IDAT(png_structrp png_ptr, png_const_bytep input,
       png_ptr->zstream.avail_in = avail;
       input_len -= avail;
 
+      png_stats_begin(png_ptr, PNG_STAGE_ZLIB, png_ptr->zstream.total_in);
       ret = deflate(&png_ptr->zstream, input_len > 0 ? Z_NO_FLUSH : flush);
+      png_stats_end(png_ptr, PNG_STAGE_ZLIB, png_ptr->zstream.total_in);
 
       /* Include as-yet unconsumed input */
       input_len += png_ptr->zstream.avail_in;
@@ -990,28 +1046,36 @@ png_compress_IDAT(png_structrp png_ptr, png_const_bytep input,
        */
       if (png_ptr->zstream.avail_out == 0)
       {
-         png_bytep data = png_ptr->zbuffer_list->output;
-         uInt size = png_ptr->zbuffer_size;
+         png_compression_bufferp buffer = png_ptr->IDAT_buffer;
+         png_uint_32 length = png_ptr->IDAT_pending + (png_uint_32)
+             (png_ptr->zstream.next_out - buffer->output);
 
-         /* Write an IDAT containing the data then reset the buffer.  The
-          * first IDAT may need deflate header optimization.
+         /* If another full buffer fits in the chunk move on to the next buffer
+          * in the list, otherwise write an IDAT containing all the data.
           */
-#ifdef PNG_WRITE_OPTIMIZE_CMF_SUPPORTED
-            if ((png_ptr->mode & PNG_HAVE_IDAT) == 0 &&
-                png_ptr->compression_type == PNG_COMPRESSION_TYPE_BASE)
-               optimize_cmf(data, png_image_size(png_ptr));
-#endif
+         if (png_ptr->IDAT_chunk_size >= png_ptr->zbuffer_size &&
+             png_ptr->IDAT_chunk_size - png_ptr->zbuffer_size >= length)
+         {
+            if (buffer->next == NULL)
+            {
+               buffer->next = png_voidcast(png_compression_bufferp,
+                   png_malloc(png_ptr, PNG_COMPRESSION_BUFFER_SIZE(png_ptr)));
+               buffer->next->next = NULL;
+            }
 
-         if (size > 0)
-            png_write_complete_chunk(png_ptr, png_IDAT, data, size);
-         png_ptr->mode |= PNG_HAVE_IDAT;
+            png_ptr->IDAT_buffer = buffer->next;
+            png_ptr->IDAT_pending = length;
+         }
 
-         png_ptr->zstream.next_out = data;
-         png_ptr->zstream.avail_out = size;
+         else
+            png_write_IDAT_buffers(png_ptr, length);
 
-         /* For SYNC_FLUSH or FINISH it is essential to keep calling zlib with
-          * the same flush parameter until it has finished output, for NO_FLUSH
-          * it doesn't matter.
+         png_ptr->zstream.next_out = png_ptr->IDAT_buffer->output;
+         png_ptr->zstream.avail_out = png_IDAT_buffer_avail(png_ptr);
+
+         /* For SYNC_FLUSH, FULL_FLUSH or FINISH it is essential to keep calling
+          * zlib with the same flush parameter until it has finished output,
+          * for NO_FLUSH it doesn't matter.
           */
          if (ret == Z_OK && flush != Z_NO_FLUSH)
             continue;
@@ -1040,21 +1104,19 @@ png_compress_IDAT(png_structrp png_ptr, png_const_bytep input,
          /* This is the end of the IDAT data; any pending output must be
           * flushed.  For small PNG files we may still be at the beginning.
           */
-         png_bytep data = png_ptr->zbuffer_list->output;
-         uInt size = png_ptr->zbuffer_size - png_ptr->zstream.avail_out;
+         png_uint_32 length = png_ptr->IDAT_pending + (png_uint_32)
+             (png_ptr->zstream.next_out - png_ptr->IDAT_buffer->output);
 
-#ifdef PNG_WRITE_OPTIMIZE_CMF_SUPPORTED
-         if ((png_ptr->mode & PNG_HAVE_IDAT) == 0 &&
-             png_ptr->compression_type == PNG_COMPRESSION_TYPE_BASE)
-            optimize_cmf(data, png_image_size(png_ptr));
-#endif
-
-         if (size > 0)
-            png_write_complete_chunk(png_ptr, png_IDAT, data, size);
+         if (length > 0)
+            png_write_IDAT_buffers(png_ptr, length);
          png_ptr->zstream.avail_out = 0;
          png_ptr->zstream.next_out = NULL;
          png_ptr->mode |= PNG_HAVE_IDAT | PNG_AFTER_IDAT;
 
+         /* Release the buffers used to collect a large IDAT chunk. */
+         png_free_buffer_list(png_ptr, &png_ptr->zbuffer_list->next);
+         png_ptr->IDAT_buffer = NULL;
+
          png_ptr->zowner = 0; /* Release the stream */
          return;
       }
@@ -1493,6 +1555,36 @@ png_write_eXIf(png_structrp png_ptr, png_bytep exif, int num_exif)
 }
 #endif
 
+#ifdef PNG_WRITE_reST_SUPPORTED
+/* Write the private reST chunk, which lists the restart points made by
+ * png_write_flush with the PNG_FLUSH_RESTART option.  Each entry is eight
+ * bytes: the number of the first row after the restart point and the offset of
+ * the point in the zlib stream formed by the concatenated IDAT chunk data.  The
+ * chunk is ancillary and unsafe-to-copy, because any change to the image data
+ * invalidates the offsets.
+ */
+void /* PRIVATE */
+png_write_reST(png_structrp png_ptr, png_const_uint_32p points,
+    png_uint_32 num_points)
+{
+   png_uint_32 i;
+   png_byte buf[8];
+
+   png_debug(1, "in png_write_reST");
+
+   png_write_chunk_header(png_ptr, png_reST, num_points * 8);
+
+   for (i = 0; i < num_points; i++)
+   {
+      png_save_uint_32(buf, points[2*i]);
+      png_save_uint_32(buf + 4, points[2*i + 1]);
+      png_write_chunk_data(png_ptr, buf, 8);
+   }
+
+   png_write_chunk_end(png_ptr);
+}
+#endif
+
 #ifdef PNG_WRITE_hIST_SUPPORTED
 /* Write the histogram */
 void /* PRIVATE */
@@ -2086,14 +2178,18 @@ png_write_finish_row(png_structrp png_ptr)
 
 #ifdef PNG_WRITE_INTERLACING_SUPPORTED
 /* Pick out the correct pixels for the interlace pass.
- * The basic idea here is to go through the row with a source
+ * The basic idea here is to go through the source row with a source
  * pointer and a destination pointer (sp and dp), and copy the
- * correct pixels for the pass.  As the row gets compacted,
- * sp will always be >= dp, so we should never overwrite anything.
- * See the default: case for the easiest code to understand.
+ * correct pixels for the pass into 'row'.  The source may be 'row'
+ * itself; as the row gets compacted, sp will always be >= dp, so we
+ * should never overwrite anything.  Passing the application's row as
+ * the source avoids copying the whole row before the pixels for the
+ * pass are picked out.  See the default: case for the easiest code to
+ * understand.
  */
 void /* PRIVATE */
-png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
+png_do_write_interlace(png_row_infop row_info, png_const_bytep src,
+    png_bytep row, int pass)
 {
    /* Arrays to facilitate easy interlacing - use pass (0 - 6) as index */
 
@@ -2113,7 +2209,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
       {
          case 1:
          {
-            png_bytep sp;
+            png_const_bytep sp;
             png_bytep dp;
             unsigned int shift;
             int d;
@@ -2128,7 +2224,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
             for (i = png_pass_start[pass]; i < row_width;
                i += png_pass_inc[pass])
             {
-               sp = row + (size_t)(i >> 3);
+               sp = src + (size_t)(i >> 3);
                value = (int)(*sp >> (7 - (int)(i & 0x07))) & 0x01;
                d |= (value << shift);
 
@@ -2151,7 +2247,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
 
          case 2:
          {
-            png_bytep sp;
+            png_const_bytep sp;
             png_bytep dp;
             unsigned int shift;
             int d;
@@ -2166,7 +2262,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
             for (i = png_pass_start[pass]; i < row_width;
                i += png_pass_inc[pass])
             {
-               sp = row + (size_t)(i >> 2);
+               sp = src + (size_t)(i >> 2);
                value = (*sp >> ((3 - (int)(i & 0x03)) << 1)) & 0x03;
                d |= (value << shift);
 
@@ -2188,7 +2284,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
 
          case 4:
          {
-            png_bytep sp;
+            png_const_bytep sp;
             png_bytep dp;
             unsigned int shift;
             int d;
@@ -2202,7 +2298,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
             for (i = png_pass_start[pass]; i < row_width;
                 i += png_pass_inc[pass])
             {
-               sp = row + (size_t)(i >> 1);
+               sp = src + (size_t)(i >> 1);
                value = (*sp >> ((1 - (int)(i & 0x01)) << 2)) & 0x0f;
                d |= (value << shift);
 
@@ -2222,9 +2318,80 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
             break;
          }
 
+         /* The common byte sized pixels are gathered with fixed size copies,
+          * which compilers turn into single loads and stores.  When 'src' is
+          * 'row' a pixel is either copied onto itself or from beyond the end
+          * of the output so far, so the byte by byte copies are safe.
+          */
+         case 8:
+         {
+            png_const_bytep sp = src + png_pass_start[pass];
+            png_bytep dp = row;
+            png_uint_32 i;
+            png_uint_32 row_width = row_info->width;
+
+            for (i = png_pass_start[pass]; i < row_width;
+               i += png_pass_inc[pass], sp += png_pass_inc[pass])
+               *dp++ = *sp;
+
+            break;
+         }
+
+         case 24:
+         {
+            png_const_bytep sp = src + png_pass_start[pass] * 3;
+            png_bytep dp = row;
+            png_uint_32 i;
+            png_uint_32 row_width = row_info->width;
+            size_t inc = png_pass_inc[pass] * 3;
+
+            for (i = png_pass_start[pass]; i < row_width;
+               i += png_pass_inc[pass], sp += inc, dp += 3)
+            {
+               dp[0] = sp[0]; dp[1] = sp[1]; dp[2] = sp[2];
+            }
+
+            break;
+         }
+
+         case 32:
+         {
+            png_const_bytep sp = src + png_pass_start[pass] * 4;
+            png_bytep dp = row;
+            png_uint_32 i;
+            png_uint_32 row_width = row_info->width;
+            size_t inc = png_pass_inc[pass] * 4;
+
+            for (i = png_pass_start[pass]; i < row_width;
+               i += png_pass_inc[pass], sp += inc, dp += 4)
+            {
+               dp[0] = sp[0]; dp[1] = sp[1]; dp[2] = sp[2]; dp[3] = sp[3];
+            }
+
+            break;
+         }
+
+         case 64:
+         {
+            png_const_bytep sp = src + png_pass_start[pass] * 8;
+            png_bytep dp = row;
+            png_uint_32 i;
+            png_uint_32 row_width = row_info->width;
+            size_t inc = png_pass_inc[pass] * 8;
+
+            for (i = png_pass_start[pass]; i < row_width;
+               i += png_pass_inc[pass], sp += inc, dp += 8)
+            {
+               dp[0] = sp[0]; dp[1] = sp[1]; dp[2] = sp[2]; dp[3] = sp[3];
+               dp[4] = sp[4]; dp[5] = sp[5]; dp[6] = sp[6]; dp[7] = sp[7];
+            }
+
+            break;
+         }
+
          default:
          {
-            png_bytep sp;
+            png_const_bytep sp;
             png_bytep dp;
             png_uint_32 i;
             png_uint_32 row_width = row_info->width;
@@ -2241,7 +2408,7 @@ png_do_write_interlace(png_row_infop row_info, png_bytep row, int pass)
                i += png_pass_inc[pass])
             {
                /* Find out where the original pixel is */
-               sp = row + (size_t)i * pixel_bytes;
+               sp = src + (size_t)i * pixel_bytes;
 
                /* Move the pixel */
                if (dp != sp)
@@ -2561,6 +2728,8 @@ png_write_find_filter(png_structrp png_ptr, png_row_infop row_info)
 
    png_debug(1, "in png_write_find_filter");
 
+   png_stats_begin(png_ptr, PNG_STAGE_FILTER, 0);
+
    /* Find out how many bytes offset each pixel is */
    bpp = (row_info->pixel_depth + 7) >> 3;
 
@@ -2568,6 +2737,18 @@ png_write_find_filter(png_structrp png_ptr, png_row_infop row_info)
    mins = PNG_SIZE_MAX - 256/* so we can detect potential overflow of the
                                running sum */;
 
+   /* The first row after a restart point (see png_write_flush) may only use
+    * the filters that do not refer to the previous row.
+    */
+   if ((png_ptr->flags & PNG_FLAG_RESTART_ROW) != 0)
+   {
+      png_ptr->flags &= ~PNG_FLAG_RESTART_ROW;
+      filter_to_do &= PNG_FILTER_NONE | PNG_FILTER_SUB;
+
+      if (filter_to_do == 0)
+         filter_to_do = PNG_FILTER_NONE;
+   }
+
    /* The prediction method we use is to find which method provides the
     * smallest value when summing the absolute values of the distances
     * from zero, using anything >= 128 as negative numbers.  This is known
@@ -2735,6 +2916,8 @@ png_write_find_filter(png_structrp png_ptr, png_row_infop row_info)
       }
    }
 
+   png_stats_end(png_ptr, PNG_STAGE_FILTER, row_bytes);
+
    /* Do the actual writing of the filtered row data from the chosen filter. */
    png_write_filtered_row(png_ptr, best_row, row_info->rowbytes+1);
 
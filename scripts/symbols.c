@@ -43,6 +43,8 @@
 #define PNG_INCH_CONVERSIONS_SUPPORTED
 #define PNG_READ_16_TO_8_ACCURATE_SCALE_SUPPORTED
 #define PNG_SET_OPTION_SUPPORTED
+#define PNG_PIPELINE_STATS_SUPPORTED
+#define PNG_MEMORY_BUDGET_SUPPORTED
 
 #undef PNG_H
 #include "../png.h"